@@ -68,8 +68,17 @@ godot_bool godot_arvr_initialize(void *p_data) {
 	if (arvr_data->openxr_api != NULL) {
 		// TODO reset state if necessary
 
-		// We're good
-		ret = true;
+		if (arvr_data->openxr_api->initialize()) {
+			// We're good
+			ret = true;
+		} else {
+			godot::Godot::print_error("OpenXR init failed", __FUNCTION__, __FILE__, __LINE__);
+
+			// clean up whatever we did manage to set up
+			arvr_data->openxr_api->uninitialize();
+			OpenXRApi::openxr_release_api();
+			arvr_data->openxr_api = NULL;
+		}
 	}
 
 	// and return our result
@@ -90,6 +99,7 @@ void godot_arvr_uninitialize(void *p_data) {
 		};
 		*/
 
+		arvr_data->openxr_api->uninitialize();
 		OpenXRApi::openxr_release_api();
 		arvr_data->openxr_api = NULL;
 	};
@@ -0,0 +1,625 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Extra composition layers we submit next to our projection layer, each with its own swapchain
+
+#include "CompositionLayers.h"
+#include "OpenXRApi.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace godot;
+
+CompositionLayers::CompositionLayers() {
+	next_id = 1;
+	max_layers = 15; // OpenXR guarantees at least 16 layers
+	for (int s = 0; s < SHAPE_MAX; s++) {
+		// quads are core, everything else is an extension
+		shape_supported[s] = s == SHAPE_QUAD;
+	}
+	color_scale_bias_supported = false;
+	projection_color_scale = { 1.0, 1.0, 1.0, 1.0 };
+	projection_color_bias = { 0.0, 0.0, 0.0, 0.0 };
+	swapchain_format = 0;
+	stats = {};
+
+	// our sources are Godot viewports in whatever format they have, a blit converts for us
+	copy_engine.set_requested_method(CopyEngine::METHOD_BLIT);
+}
+
+void CompositionLayers::select_format(const int64_t *p_runtime_formats, uint32_t p_runtime_format_count, int64_t p_fallback) {
+	// Godots 2D viewports hold sRGB encoded 8 bit colour, storing that as is keeps our panels exactly as Godot drew them
+	const int64_t preferred[] = { GL_SRGB8_ALPHA8, GL_RGBA8 };
+
+	std::lock_guard<std::mutex> lock(mutex);
+	swapchain_format = p_fallback;
+	for (int p = 0; p < 2; p++) {
+		for (uint32_t i = 0; i < p_runtime_format_count; i++) {
+			if (p_runtime_formats[i] == preferred[p]) {
+				swapchain_format = preferred[p];
+				return;
+			}
+		}
+	}
+}
+
+CompositionLayers::Layer *CompositionLayers::find_layer(int p_id) {
+	for (size_t i = 0; i < layers.size(); i++) {
+		if (layers[i].id == p_id) {
+			return &layers[i];
+		}
+	}
+
+	return NULL;
+}
+
+int CompositionLayers::add_layer(Shape p_shape, const XrExtent2Df &p_size) {
+	Layer layer;
+	layer.shape = p_shape;
+	// a cube or an equirect is our sky or our video, it goes behind everything
+	layer.sort_order = p_shape == SHAPE_CUBE || p_shape == SHAPE_EQUIRECT ? -1 : 0;
+	layer.visible = true;
+	layer.alpha_blend = false;
+	layer.pose = { { 0.0, 0.0, 0.0, 1.0 }, { 0.0, 0.0, 0.0 } };
+	layer.size = p_size;
+	layer.radius = p_shape == SHAPE_EQUIRECT ? 0.0 : 1.0;
+	layer.central_angle = p_shape == SHAPE_EQUIRECT ? 2.0f * MATH_PI : 1.0f;
+	layer.upper_vertical_angle = MATH_PI / 2.0f;
+	layer.lower_vertical_angle = -MATH_PI / 2.0f;
+	layer.color_scale = { 1.0, 1.0, 1.0, 1.0 };
+	layer.color_bias = { 0.0, 0.0, 0.0, 0.0 };
+	layer.sources.resize(p_shape == SHAPE_CUBE ? CUBE_FACES : 1, 0);
+	layer.source_width = 0;
+	layer.source_height = 0;
+	layer.dirty = false;
+	layer.swapchain = XR_NULL_HANDLE;
+	layer.swapchain_width = 0;
+	layer.swapchain_height = 0;
+	layer.image_acquired = false;
+	layer.image_index = 0;
+	layer.has_content = false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	layer.id = next_id++;
+	layers.push_back(layer);
+	stats.layers = (uint32_t)layers.size();
+
+	return layer.id;
+}
+
+void CompositionLayers::remove_layer(int p_id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < layers.size(); i++) {
+		if (layers[i].id == p_id) {
+			free_swapchain(layers[i], true);
+			if (layers[i].stream != NULL) {
+				wait_for_writers(layers[i].stream);
+				layers[i].stream->cleanup();
+			}
+			layers.erase(layers.begin() + i);
+			break;
+		}
+	}
+	stats.layers = (uint32_t)layers.size();
+}
+
+void CompositionLayers::wait_for_writers(const std::shared_ptr<StreamUploader> &p_stream) {
+	// Writers only take a reference while holding our mutex, which our caller holds,
+	// so this only waits for a writer that is copying a frame in right now.
+	while (p_stream.use_count() > 1) {
+		std::this_thread::yield();
+	}
+}
+
+bool CompositionLayers::has_sources(const Layer &p_layer) {
+	for (size_t i = 0; i < p_layer.sources.size(); i++) {
+		if (p_layer.sources[i] == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CompositionLayers::has_layer(int p_id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return find_layer(p_id) != NULL;
+}
+
+void CompositionLayers::set_pose(int p_id, const XrPosef &p_pose) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->pose = p_pose;
+	}
+}
+
+void CompositionLayers::set_size(int p_id, const XrExtent2Df &p_size) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->size = p_size;
+	}
+}
+
+void CompositionLayers::set_cylinder(int p_id, float p_radius, float p_central_angle) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->radius = p_radius;
+		layer->central_angle = p_central_angle;
+	}
+}
+
+void CompositionLayers::set_equirect(int p_id, float p_radius, float p_central_horizontal_angle, float p_upper_vertical_angle, float p_lower_vertical_angle) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->radius = p_radius;
+		layer->central_angle = p_central_horizontal_angle;
+		layer->upper_vertical_angle = p_upper_vertical_angle;
+		layer->lower_vertical_angle = p_lower_vertical_angle;
+	}
+}
+
+bool CompositionLayers::create_stream(int p_id, uint32_t p_width, uint32_t p_height) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer == NULL) {
+		return false;
+	} else if (layer->shape != SHAPE_EQUIRECT && layer->shape != SHAPE_QUAD) {
+		// our stream uploads into a single 2D image, cube layers need six faces and cylinders are fed by viewports
+		Godot::print("OpenXR layer {0} can't be streamed to, only equirect and quad layers can", p_id);
+		return false;
+	}
+
+	if (layer->stream == NULL) {
+		layer->stream = std::make_shared<StreamUploader>();
+	} else {
+		wait_for_writers(layer->stream);
+	}
+	if (!layer->stream->setup(p_width, p_height)) {
+		return false;
+	}
+
+	// our swapchain is recreated at this size with our next frame
+	layer->source_width = p_width;
+	layer->source_height = p_height;
+	return true;
+}
+
+bool CompositionLayers::write_stream_frame(int p_id, const uint8_t *p_data, size_t p_size) {
+	std::shared_ptr<StreamUploader> stream;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Layer *layer = find_layer(p_id);
+		if (layer != NULL) {
+			stream = layer->stream;
+		}
+	}
+
+	// our stream does its own locking, we don't hold up our render thread while we copy,
+	// our reference keeps remove_layer() from freeing our stream until we're done
+	return stream != NULL && stream->write_frame(p_data, p_size);
+}
+
+void CompositionLayers::free_streams() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < layers.size(); i++) {
+		if (layers[i].stream != NULL) {
+			wait_for_writers(layers[i].stream);
+			layers[i].stream->cleanup();
+		}
+	}
+}
+
+bool CompositionLayers::get_stream_stats(int p_id, StreamUploader::Stats *r_stats) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer == NULL || layer->stream == NULL) {
+		return false;
+	}
+
+	*r_stats = layer->stream->get_stats();
+	return true;
+}
+
+void CompositionLayers::set_visible(int p_id, bool p_visible) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->visible = p_visible;
+	}
+}
+
+void CompositionLayers::set_alpha_blend(int p_id, bool p_alpha_blend) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->alpha_blend = p_alpha_blend;
+	}
+}
+
+void CompositionLayers::set_sort_order(int p_id, int p_sort_order) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->sort_order = p_sort_order;
+	}
+}
+
+bool CompositionLayers::is_identity(const XrColor4f &p_scale, const XrColor4f &p_bias) {
+	return p_scale.r == 1.0 && p_scale.g == 1.0 && p_scale.b == 1.0 && p_scale.a == 1.0 && p_bias.r == 0.0 && p_bias.g == 0.0 && p_bias.b == 0.0 && p_bias.a == 0.0;
+}
+
+void CompositionLayers::set_color_scale_bias(int p_id, const XrColor4f &p_scale, const XrColor4f &p_bias) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL) {
+		layer->color_scale = p_scale;
+		layer->color_bias = p_bias;
+	}
+}
+
+void CompositionLayers::set_projection_color_scale_bias(const XrColor4f &p_scale, const XrColor4f &p_bias) {
+	std::lock_guard<std::mutex> lock(mutex);
+	projection_color_scale = p_scale;
+	projection_color_bias = p_bias;
+}
+
+const void *CompositionLayers::get_projection_next() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// don't chain anything the runtime would have to skip or that doesn't change anything
+	if (!color_scale_bias_supported || is_identity(projection_color_scale, projection_color_bias)) {
+		return NULL;
+	}
+
+	submit_projection_color_scale_bias = {
+		.type = XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR,
+		.next = NULL,
+		.colorScale = projection_color_scale,
+		.colorBias = projection_color_bias
+	};
+	return &submit_projection_color_scale_bias;
+}
+
+void CompositionLayers::set_source(int p_id, int p_face, GLuint p_texture, uint32_t p_width, uint32_t p_height) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Layer *layer = find_layer(p_id);
+	if (layer != NULL && p_face >= 0 && p_face < (int)layer->sources.size()) {
+		layer->sources[p_face] = p_texture;
+		layer->source_width = p_width;
+		layer->source_height = p_height;
+		// we copy all our faces together once we have them all
+		layer->dirty = has_sources(*layer);
+	}
+}
+
+bool CompositionLayers::create_swapchain(XrSession p_session, Layer &p_layer) {
+	uint32_t face_count = (uint32_t)p_layer.sources.size();
+	if (face_count > 1 && p_layer.source_width != p_layer.source_height) {
+		Godot::print("OpenXR the faces of cube layer {0} must be square, not {1}x{2}", p_layer.id, (int64_t)p_layer.source_width, (int64_t)p_layer.source_height);
+		return false;
+	}
+
+	XrSwapchainCreateInfo swapchainCreateInfo = {
+		.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+		.next = NULL,
+		.createFlags = 0,
+		// streams upload straight into our images
+		.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | (p_layer.stream != NULL ? XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT : 0),
+		.format = swapchain_format,
+		.sampleCount = 1,
+		.width = p_layer.source_width,
+		.height = p_layer.source_height,
+		.faceCount = face_count,
+		.arraySize = 1,
+		.mipCount = 1,
+	};
+
+	XrResult result = xrCreateSwapchain(p_session, &swapchainCreateInfo, &p_layer.swapchain);
+	if (XR_FAILED(result)) {
+		Godot::print("OpenXR failed to create swapchain for layer {0} ({1})", p_layer.id, (int64_t)result);
+		p_layer.swapchain = XR_NULL_HANDLE;
+		return false;
+	}
+
+	uint32_t image_count = 0;
+	result = xrEnumerateSwapchainImages(p_layer.swapchain, 0, &image_count, NULL);
+	std::vector<XrSwapchainImageOpenGLKHR> images(image_count);
+	for (uint32_t i = 0; i < image_count; i++) {
+		images[i].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR;
+		images[i].next = NULL;
+	}
+	if (XR_SUCCEEDED(result)) {
+		result = xrEnumerateSwapchainImages(p_layer.swapchain, image_count, &image_count, (XrSwapchainImageBaseHeader *)images.data());
+	}
+	if (XR_FAILED(result)) {
+		Godot::print("OpenXR failed to enumerate swapchain images for layer {0} ({1})", p_layer.id, (int64_t)result);
+		free_swapchain(p_layer, true);
+		return false;
+	}
+
+	p_layer.swapchain_width = p_layer.source_width;
+	p_layer.swapchain_height = p_layer.source_height;
+	for (uint32_t i = 0; i < image_count; i++) {
+		p_layer.images.push_back(images[i].image);
+		if (face_count > 1) {
+			for (uint32_t f = 0; f < face_count; f++) {
+				p_layer.framebuffers.push_back(CopyEngine::create_framebuffer(GL_COLOR_ATTACHMENT0, images[i].image, f, false, true));
+			}
+		} else {
+			p_layer.framebuffers.push_back(CopyEngine::create_framebuffer(GL_COLOR_ATTACHMENT0, images[i].image, -1, false, false));
+		}
+	}
+
+	return true;
+}
+
+void CompositionLayers::free_swapchain(Layer &p_layer, bool p_destroy) {
+	if (!p_layer.framebuffers.empty()) {
+		// deleting 0 is silently ignored
+		glDeleteFramebuffers((GLsizei)p_layer.framebuffers.size(), p_layer.framebuffers.data());
+	}
+	p_layer.framebuffers.clear();
+	p_layer.images.clear();
+
+	if (p_destroy && p_layer.swapchain != XR_NULL_HANDLE) {
+		xrDestroySwapchain(p_layer.swapchain);
+	}
+	p_layer.swapchain = XR_NULL_HANDLE;
+	p_layer.swapchain_width = 0;
+	p_layer.swapchain_height = 0;
+	p_layer.image_acquired = false; // destroying our swapchain releases it
+	p_layer.has_content = false;
+
+	// whatever we had in our old swapchain needs copying into our new one
+	p_layer.dirty = has_sources(p_layer);
+}
+
+bool CompositionLayers::update_layer(XrSession p_session, Layer &p_layer) {
+	if (p_layer.swapchain != XR_NULL_HANDLE && (p_layer.swapchain_width != p_layer.source_width || p_layer.swapchain_height != p_layer.source_height)) {
+		// our source was resized
+		free_swapchain(p_layer, true);
+	}
+
+	if (p_layer.swapchain == XR_NULL_HANDLE && !create_swapchain(p_session, p_layer)) {
+		// don't keep trying every frame, we try again when our source changes
+		p_layer.dirty = false;
+		return false;
+	}
+
+	XrResult result;
+	if (!p_layer.image_acquired) {
+		XrSwapchainImageAcquireInfo acquireInfo = {
+			.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO,
+			.next = NULL
+		};
+		result = xrAcquireSwapchainImage(p_layer.swapchain, &acquireInfo, &p_layer.image_index);
+		if (XR_FAILED(result)) {
+			Godot::print("OpenXR failed to acquire swapchain image for layer {0} ({1})", p_layer.id, (int64_t)result);
+			return false;
+		}
+		p_layer.image_acquired = true;
+	}
+
+	// We're on Godots render thread, don't hold up the game if our runtime is still reading our image.
+	// XR_TIMEOUT_EXPIRED is a success code, we keep our image acquired and wait for it again next frame.
+	XrSwapchainImageWaitInfo waitInfo = {
+		.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
+		.next = NULL,
+		.timeout = IMAGE_WAIT_TIMEOUT
+	};
+	result = xrWaitSwapchainImage(p_layer.swapchain, &waitInfo);
+	if (result == XR_TIMEOUT_EXPIRED) {
+		stats.wait_timeouts++;
+		return false;
+	} else if (XR_FAILED(result)) {
+		// we can only release an image we waited for, it stays acquired and we try again next frame
+		Godot::print("OpenXR failed to wait for swapchain image for layer {0} ({1})", p_layer.id, (int64_t)result);
+		return false;
+	}
+
+	uint32_t index = p_layer.image_index;
+	if (p_layer.stream != NULL) {
+		// no copy, our pixel buffer is uploaded into our image
+		p_layer.stream->upload(p_layer.images[index]);
+	} else {
+		uint32_t face_count = (uint32_t)p_layer.sources.size();
+		for (uint32_t f = 0; f < face_count; f++) {
+			CopyEngine::Target target;
+			target.texture = p_layer.images[index];
+			target.layer = face_count > 1 ? (GLint)f : -1;
+			target.x = 0;
+			target.framebuffer = p_layer.framebuffers[index * face_count + f];
+			target.multisample = false;
+			target.cube_map = face_count > 1;
+			copy_engine.copy(p_layer.sources[f], target, p_layer.source_width, p_layer.source_height);
+		}
+	}
+
+	XrSwapchainImageReleaseInfo releaseInfo = {
+		.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO,
+		.next = NULL
+	};
+	p_layer.image_acquired = false;
+	result = xrReleaseSwapchainImage(p_layer.swapchain, &releaseInfo);
+	if (XR_FAILED(result)) {
+		Godot::print("OpenXR failed to release swapchain image for layer {0} ({1})", p_layer.id, (int64_t)result);
+		return false;
+	}
+
+	p_layer.has_content = true;
+	p_layer.dirty = false;
+	stats.updates++;
+	return true;
+}
+
+void CompositionLayers::update(XrSession p_session) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (p_session == XR_NULL_HANDLE || swapchain_format == 0) {
+		return;
+	}
+
+	uint64_t start = OpenXRApi::get_time_usec();
+	bool updated = false;
+	for (size_t i = 0; i < layers.size(); i++) {
+		if (layers[i].stream != NULL && layers[i].stream->get_frame_size() == 0 && layers[i].source_width > 0) {
+			// our buffers were freed with our last session, frames written until now were dropped
+			layers[i].stream->setup(layers[i].source_width, layers[i].source_height);
+		}
+
+		// hidden layers are copied once they're shown again, streams only update when they have a new frame
+		bool pending = layers[i].stream != NULL ? layers[i].stream->has_pending() : layers[i].dirty;
+		if (layers[i].visible && pending && shape_supported[layers[i].shape]) {
+			updated = update_layer(p_session, layers[i]) || updated;
+		}
+	}
+
+	if (updated) {
+		stats.last_update_usec = OpenXRApi::get_time_usec() - start;
+	}
+}
+
+bool CompositionLayers::has_layers_behind() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < layers.size(); i++) {
+		if (layers[i].visible && layers[i].sort_order < 0 && shape_supported[layers[i].shape] && (has_sources(layers[i]) || layers[i].stream != NULL)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CompositionLayers::fill_layer(const Layer &p_layer, XrSpace p_space, SubmitLayer &r_submit, XrCompositionLayerColorScaleBiasKHR &r_color_scale_bias) {
+	XrCompositionLayerFlags flags = 0;
+	if (p_layer.alpha_blend) {
+		// Godot doesn't premultiply the alpha of its viewports
+		flags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT | XR_COMPOSITION_LAYER_UNPREMULTIPLIED_ALPHA_BIT;
+	}
+
+	XrSwapchainSubImage sub_image = {
+		.swapchain = p_layer.swapchain,
+		.imageRect = {
+				.offset = { 0, 0 },
+				.extent = { (int32_t)p_layer.swapchain_width, (int32_t)p_layer.swapchain_height } },
+		.imageArrayIndex = 0
+	};
+
+	switch (p_layer.shape) {
+		case SHAPE_QUAD: {
+			r_submit.quad = {
+				.type = XR_TYPE_COMPOSITION_LAYER_QUAD,
+				.next = NULL,
+				.layerFlags = flags,
+				.space = p_space,
+				.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+				.subImage = sub_image,
+				.pose = p_layer.pose,
+				.size = p_layer.size
+			};
+		} break;
+		case SHAPE_CYLINDER: {
+			r_submit.cylinder = {
+				.type = XR_TYPE_COMPOSITION_LAYER_CYLINDER_KHR,
+				.next = NULL,
+				.layerFlags = flags,
+				.space = p_space,
+				.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+				.subImage = sub_image,
+				.pose = p_layer.pose,
+				.radius = p_layer.radius,
+				.centralAngle = p_layer.central_angle,
+				// width over height of the part of our cylinder we cover, our source isn't stretched
+				.aspectRatio = (float)p_layer.swapchain_width / (float)p_layer.swapchain_height
+			};
+		} break;
+		case SHAPE_CUBE: {
+			r_submit.cube = {
+				.type = XR_TYPE_COMPOSITION_LAYER_CUBE_KHR,
+				.next = NULL,
+				.layerFlags = flags,
+				.space = p_space,
+				.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+				.swapchain = p_layer.swapchain,
+				.imageArrayIndex = 0,
+				.orientation = p_layer.pose.orientation
+			};
+		} break;
+		case SHAPE_EQUIRECT: {
+			r_submit.equirect = {
+				.type = XR_TYPE_COMPOSITION_LAYER_EQUIRECT2_KHR,
+				.next = NULL,
+				.layerFlags = flags,
+				.space = p_space,
+				.eyeVisibility = XR_EYE_VISIBILITY_BOTH,
+				.subImage = sub_image,
+				.pose = p_layer.pose,
+				.radius = p_layer.radius,
+				.centralHorizontalAngle = p_layer.central_angle,
+				.upperVerticalAngle = p_layer.upper_vertical_angle,
+				.lowerVerticalAngle = p_layer.lower_vertical_angle
+			};
+		} break;
+		default:
+			break;
+	}
+
+	if (color_scale_bias_supported && !is_identity(p_layer.color_scale, p_layer.color_bias)) {
+		r_color_scale_bias = {
+			.type = XR_TYPE_COMPOSITION_LAYER_COLOR_SCALE_BIAS_KHR,
+			.next = NULL,
+			.colorScale = p_layer.color_scale,
+			.colorBias = p_layer.color_bias
+		};
+		r_submit.header.next = &r_color_scale_bias;
+	}
+}
+
+static bool compare_sort_order(const std::pair<int, size_t> &p_a, const std::pair<int, size_t> &p_b) {
+	return p_a.first < p_b.first;
+}
+
+void CompositionLayers::get_submit_layers(XrSpace p_space, std::vector<const XrCompositionLayerBaseHeader *> &r_behind, std::vector<const XrCompositionLayerBaseHeader *> &r_in_front) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	r_behind.clear();
+	r_in_front.clear();
+
+	// sort_order and then the order our layers were added in
+	std::vector<std::pair<int, size_t> > order;
+	for (size_t i = 0; i < layers.size(); i++) {
+		if (layers[i].visible && layers[i].has_content && shape_supported[layers[i].shape]) {
+			order.push_back(std::make_pair(layers[i].sort_order, i));
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), compare_sort_order);
+	if (order.size() > max_layers) {
+		order.resize(max_layers);
+	}
+
+	// size this up front, we hand out pointers into it
+	submit_layers.resize(order.size());
+	submit_color_scale_bias.resize(order.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		const Layer &layer = layers[order[i].second];
+		fill_layer(layer, p_space, submit_layers[i], submit_color_scale_bias[i]);
+		if (layer.sort_order < 0) {
+			r_behind.push_back(&submit_layers[i].header);
+		} else {
+			r_in_front.push_back(&submit_layers[i].header);
+		}
+	}
+
+	stats.submitted = (uint32_t)order.size();
+}
+
+void CompositionLayers::free_swapchains() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < layers.size(); i++) {
+		free_swapchain(layers[i], false);
+	}
+	swapchain_format = 0;
+	copy_engine.cleanup();
+}
@@ -0,0 +1,176 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Extra composition layers we submit next to our projection layer, each with its own swapchain
+
+#ifndef COMPOSITION_LAYERS_H
+#define COMPOSITION_LAYERS_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CopyEngine.h"
+#include "StreamUploader.h"
+#include <openxr/openxr.h>
+
+class CompositionLayers {
+public:
+	enum Shape {
+		SHAPE_QUAD, // XrCompositionLayerQuad, a flat panel in our play space
+		SHAPE_CYLINDER, // XrCompositionLayerCylinderKHR, a panel curved around its center, needs XR_KHR_composition_layer_cylinder
+		SHAPE_CUBE, // XrCompositionLayerCubeKHR, a cube map at infinity, needs XR_KHR_composition_layer_cube
+		SHAPE_EQUIRECT, // XrCompositionLayerEquirect2KHR, i.e. 360 degree video, needs XR_KHR_composition_layer_equirect2
+		SHAPE_MAX
+	};
+
+	enum {
+		CUBE_FACES = 6
+	};
+
+	// How long we wait for a layers swapchain image on Godots render thread, 2ms in nanoseconds.
+	// If our runtime still holds it we keep it acquired and try again with our next frame.
+	static const XrDuration IMAGE_WAIT_TIMEOUT = 2000000;
+
+	struct Stats {
+		uint32_t layers; // layers that exist, visible or not
+		uint32_t submitted; // layers we submitted with our last frame
+		uint64_t updates; // times we copied a layers source into its swapchain
+		uint64_t last_update_usec; // CPU time of our last frame that updated at least one layer
+		uint64_t wait_timeouts; // updates put off to our next frame because our runtime still held our image
+	};
+
+private:
+	struct Layer {
+		int id;
+		Shape shape;
+		int sort_order; // below 0 we're submitted behind our projection layer, otherwise in front of it, cubes and equirects default to -1
+		bool visible;
+		bool alpha_blend; // our source has straight alpha we want blended with the layers behind us
+		XrPosef pose; // in our play space
+		XrExtent2Df size; // in meters
+		float radius; // cylinders and equirects, in meters, 0 puts an equirect at infinity
+		float central_angle; // cylinders and equirects, the horizontal angle we cover in radians
+		float upper_vertical_angle; // equirects only, in radians
+		float lower_vertical_angle;
+
+		// Frames written by our CPU instead of a GL texture we copy, NULL if we copy our sources.
+		// Writers hold a reference while they copy a frame in so we never free it under them.
+		std::shared_ptr<StreamUploader> stream;
+
+		XrColor4f color_scale; // the compositor multiplies our colour with this and then adds our bias
+		XrColor4f color_bias;
+
+		std::vector<GLuint> sources; // GL texture we copy from for each face, 0 if we don't have one yet
+		uint32_t source_width; // all our faces must be the same size
+		uint32_t source_height;
+		bool dirty; // our source changed since we last copied it
+
+		XrSwapchain swapchain;
+		uint32_t swapchain_width;
+		uint32_t swapchain_height;
+		std::vector<GLuint> images;
+		std::vector<GLuint> framebuffers; // per image and face, 0 if we attach when we copy
+		bool image_acquired; // we acquired image_index but haven't managed to wait for it yet
+		uint32_t image_index;
+		bool has_content; // we can't submit until we released an image at least once
+	};
+
+	// Storage for the layers we submit with a frame, these must stay put until xrEndFrame returns
+	union SubmitLayer {
+		XrCompositionLayerBaseHeader header;
+		XrCompositionLayerQuad quad;
+		XrCompositionLayerCylinderKHR cylinder;
+		XrCompositionLayerCubeKHR cube;
+		XrCompositionLayerEquirect2KHR equirect;
+	};
+
+	std::mutex mutex; // layers are changed from scripts and submitted when Godot renders our viewport
+	std::vector<Layer> layers;
+	std::vector<SubmitLayer> submit_layers;
+	std::vector<XrCompositionLayerColorScaleBiasKHR> submit_color_scale_bias; // chained into submit_layers at the same index
+	int next_id;
+	uint32_t max_layers; // how many layers our runtime accepts next to our projection layer
+	bool shape_supported[SHAPE_MAX]; // layers our runtime can't show aren't submitted
+	bool color_scale_bias_supported; // XR_KHR_composition_layer_color_scale_bias, scales and biases are ignored without it
+	XrColor4f projection_color_scale;
+	XrColor4f projection_color_bias;
+	XrCompositionLayerColorScaleBiasKHR submit_projection_color_scale_bias;
+	int64_t swapchain_format;
+	CopyEngine copy_engine; // separate from the one for our projection layer, our sources have their own formats
+	Stats stats;
+
+	Layer *find_layer(int p_id);
+	static bool has_sources(const Layer &p_layer);
+	static void wait_for_writers(const std::shared_ptr<StreamUploader> &p_stream);
+	static bool is_identity(const XrColor4f &p_scale, const XrColor4f &p_bias);
+	bool create_swapchain(XrSession p_session, Layer &p_layer);
+	void free_swapchain(Layer &p_layer, bool p_destroy);
+	bool update_layer(XrSession p_session, Layer &p_layer);
+	void fill_layer(const Layer &p_layer, XrSpace p_space, SubmitLayer &r_submit, XrCompositionLayerColorScaleBiasKHR &r_color_scale_bias);
+
+public:
+	CompositionLayers();
+
+	// Must be set before our first update, picks an 8 bit format from the formats our runtime supports
+	void select_format(const int64_t *p_runtime_formats, uint32_t p_runtime_format_count, int64_t p_fallback);
+
+	void set_max_layers(uint32_t p_max_layers) { max_layers = p_max_layers; }
+	void set_shape_supported(Shape p_shape, bool p_supported) { shape_supported[p_shape] = p_supported; }
+	bool is_shape_supported(Shape p_shape) const { return shape_supported[p_shape]; }
+	void set_color_scale_bias_supported(bool p_supported) { color_scale_bias_supported = p_supported; }
+	bool is_color_scale_bias_supported() const { return color_scale_bias_supported; }
+
+	// Layers are created with a size in meters and an identity pose, they're submitted once they have a source.
+	// Cubes only use our orientation and need a source for each face.
+	int add_layer(Shape p_shape, const XrExtent2Df &p_size);
+	void remove_layer(int p_id);
+	bool has_layer(int p_id);
+
+	void set_pose(int p_id, const XrPosef &p_pose);
+	void set_size(int p_id, const XrExtent2Df &p_size);
+	// Our cylinders height follows from the aspect ratio of its source
+	void set_cylinder(int p_id, float p_radius, float p_central_angle);
+	void set_equirect(int p_id, float p_radius, float p_central_horizontal_angle, float p_upper_vertical_angle, float p_lower_vertical_angle);
+	void set_visible(int p_id, bool p_visible);
+	void set_alpha_blend(int p_id, bool p_alpha_blend);
+	void set_sort_order(int p_id, int p_sort_order);
+
+	// The compositor applies p_scale and then p_bias to our layers colour, i.e. a fade to black scales rgb down to 0.
+	// Nothing is copied or rendered again, it's applied to what our swapchain already has.
+	void set_color_scale_bias(int p_id, const XrColor4f &p_scale, const XrColor4f &p_bias);
+	// The same for the projection layer Godot renders into
+	void set_projection_color_scale_bias(const XrColor4f &p_scale, const XrColor4f &p_bias);
+	// What to chain into our projection layers next, NULL if there is nothing to apply. Stays valid until the next call.
+	const void *get_projection_next();
+
+	// Our layer copies p_texture into its swapchain the next time we render, call whenever its content changes.
+	// p_face is 0 for everything but cubes, their faces are in GL order (+X, -X, +Y, -Y, +Z, -Z).
+	void set_source(int p_id, int p_face, GLuint p_texture, uint32_t p_width, uint32_t p_height);
+
+	// Gives our layer a ring of pixel buffers our CPU writes its frames into, instead of a GL texture we copy.
+	// Only for equirect and quad layers. Must be called with our GL context current.
+	bool create_stream(int p_id, uint32_t p_width, uint32_t p_height);
+	// Writes a frame with rows top down into our layers stream, the newest frame is uploaded when we next render
+	bool write_stream_frame(int p_id, const uint8_t *p_data, size_t p_size);
+	bool get_stream_stats(int p_id, StreamUploader::Stats *r_stats);
+	// Frees the buffers of our streams while our GL context is still current, they're recreated with our next update
+	void free_streams();
+
+	// Copies all dirty sources and new stream frames into their swapchains, must be called with our GL context current
+	void update(XrSession p_session);
+
+	// True if we have visible layers to submit behind our projection layer
+	bool has_layers_behind();
+
+	// Fills r_behind and r_in_front with the layers to submit around our projection layer, in order.
+	// These stay valid until the next call. If we have more than our runtime accepts the last ones in our order are dropped.
+	void get_submit_layers(XrSpace p_space, std::vector<const XrCompositionLayerBaseHeader *> &r_behind, std::vector<const XrCompositionLayerBaseHeader *> &r_in_front);
+
+	// Our session is gone and took our swapchains with it, they're recreated with our next update
+	void free_swapchains();
+
+	const Stats &get_stats() const { return stats; }
+};
+
+#endif /* !COMPOSITION_LAYERS_H */
@@ -0,0 +1,839 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Copies Godots render target into our swapchain images when Godot can't render into them directly
+
+#include "CopyEngine.h"
+#include "OpenXRApi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace godot;
+
+static const char *vertex_shader_330 =
+		"#version 330 core\n"
+		"layout(location = 0) in vec2 vertex;\n"
+		"out vec2 uv;\n"
+		"void main() {\n"
+		"	uv = vertex * 0.5 + 0.5;\n"
+		"	gl_Position = vec4(vertex, 0.0, 1.0);\n"
+		"}\n";
+
+static const char *fragment_shader_330 =
+		"#version 330 core\n"
+		"uniform sampler2D source;\n"
+		"in vec2 uv;\n"
+		"layout(location = 0) out vec4 color;\n"
+		"void main() {\n"
+		"	color = texture(source, uv);\n"
+		"}\n";
+
+static const char *vertex_shader_120 =
+		"#version 120\n"
+		"attribute vec2 vertex;\n"
+		"varying vec2 uv;\n"
+		"void main() {\n"
+		"	uv = vertex * 0.5 + 0.5;\n"
+		"	gl_Position = vec4(vertex, 0.0, 1.0);\n"
+		"}\n";
+
+static const char *fragment_shader_120 =
+		"#version 120\n"
+		"uniform sampler2D source;\n"
+		"varying vec2 uv;\n"
+		"void main() {\n"
+		"	gl_FragColor = texture2D(source, uv);\n"
+		"}\n";
+
+CopyEngine::CopyEngine() {
+	initialised = false;
+	gl_major = 0;
+	copy_image_supported = false;
+	blit_supported = false;
+
+	requested = METHOD_AUTO;
+	selected = METHOD_AUTO;
+	source_format = 0;
+	target_format = 0;
+
+	framebuffers[0] = 0;
+	framebuffers[1] = 0;
+	depth_framebuffer = 0;
+	depth_verified = false;
+	depth_failed = false;
+	depth_verified_source = 0;
+	depth_verified_width = 0;
+	depth_verified_height = 0;
+	program = 0;
+	vertex_buffer = 0;
+	vertex_array = 0;
+
+	timer_supported = false;
+	timer_first = 0;
+	timer_count = 0;
+	timer_running = false;
+	for (int i = 0; i < TIMER_QUERIES; i++) {
+		timer_queries[i] = 0;
+	}
+	reset_timing();
+}
+
+CopyEngine::~CopyEngine() {
+	// our GL context may well be gone by now, cleanup() should have been called while it was current
+}
+
+bool CopyEngine::has_extension(const char *p_name) {
+	GLint major = 0;
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if (version != NULL) {
+		sscanf(version, "%d", &major);
+	}
+
+	if (major >= 3) {
+		GLint extension_count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+		for (GLint i = 0; i < extension_count; i++) {
+			const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+			if (extension != NULL && strcmp(extension, p_name) == 0) {
+				return true;
+			}
+		}
+	} else {
+		const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+		size_t len = strlen(p_name);
+		while (extensions != NULL && (extensions = strstr(extensions, p_name)) != NULL) {
+			if (extensions[len] == ' ' || extensions[len] == '\0') {
+				return true;
+			}
+			extensions += len;
+		}
+	}
+
+	return false;
+}
+
+GLuint CopyEngine::create_framebuffer(GLenum p_attachment, GLuint p_texture, GLint p_layer, bool p_multisample, bool p_cube_map) {
+	GLint read_fbo, draw_fbo;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	// bound as both so our draw and read buffer settings below end up on our framebuffer and not on Godots
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if (p_cube_map) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, p_attachment, GL_TEXTURE_CUBE_MAP_POSITIVE_X + p_layer, p_texture, 0);
+	} else if (p_layer >= 0) {
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, p_attachment, p_texture, 0, p_layer);
+	} else {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, p_attachment, get_texture_target(p_layer, p_multisample), p_texture, 0);
+	}
+	if (p_attachment != GL_COLOR_ATTACHMENT0) {
+		// depth only, GL 3.x considers this incomplete unless we say we don't draw or read colour
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		Godot::print("OpenXR framebuffer for texture {0} is incomplete ({1}), attaching it when we copy instead", (int64_t)p_texture, (int64_t)status);
+		glDeleteFramebuffers(1, &framebuffer);
+		return 0;
+	}
+
+	return framebuffer;
+}
+
+bool CopyEngine::is_gl_version_at_least(int p_major, int p_minor) {
+	int major = 0;
+	int minor = 0;
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if (version != NULL) {
+		sscanf(version, "%d.%d", &major, &minor);
+	}
+
+	return major > p_major || (major == p_major && minor >= p_minor);
+}
+
+const char *CopyEngine::get_method_name(Method p_method) {
+	switch (p_method) {
+		case METHOD_AUTO:
+			return "auto";
+		case METHOD_COPY_IMAGE:
+			return "copy_image";
+		case METHOD_BLIT:
+			return "blit";
+		case METHOD_SHADER:
+			return "shader";
+		default:
+			return "unknown";
+	}
+}
+
+void CopyEngine::set_requested_method(Method p_method) {
+	requested = p_method;
+
+	// select again on our next copy
+	selected = METHOD_AUTO;
+}
+
+void CopyEngine::initialise() {
+	const char *version = (const char *)glGetString(GL_VERSION);
+	gl_major = 0;
+	int gl_minor = 0;
+	if (version != NULL) {
+		sscanf(version, "%d.%d", &gl_major, &gl_minor);
+	}
+
+#ifdef WIN32
+	// glad only gives us GL 3.3
+	copy_image_supported = false;
+#else
+	copy_image_supported = gl_major > 4 || (gl_major == 4 && gl_minor >= 3) || has_extension("GL_ARB_copy_image");
+#endif
+	blit_supported = gl_major >= 3 || has_extension("GL_EXT_framebuffer_blit");
+	timer_supported = gl_major > 3 || (gl_major == 3 && gl_minor >= 3) || has_extension("GL_ARB_timer_query");
+
+	Godot::print("OpenXR copy engine: copy_image {0}, blit {1}", copy_image_supported ? "supported" : "unsupported", blit_supported ? "supported" : "unsupported");
+	initialised = true;
+}
+
+bool CopyEngine::create_program() {
+	bool core = gl_major >= 3;
+
+	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex_shader, 1, core ? &vertex_shader_330 : &vertex_shader_120, NULL);
+	glCompileShader(vertex_shader);
+
+	GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment_shader, 1, core ? &fragment_shader_330 : &fragment_shader_120, NULL);
+	glCompileShader(fragment_shader);
+
+	program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glBindAttribLocation(program, 0, "vertex");
+	glLinkProgram(program);
+
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		Godot::print_error(String("OpenXR failed to link our copy shader: ") + String(log), __FUNCTION__, __FILE__, __LINE__);
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+
+	GLint array_buffer;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &array_buffer);
+
+	// a single triangle covering our viewport
+	const GLfloat vertices[] = { -1.0, -1.0, 3.0, -1.0, -1.0, 3.0 };
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	if (core) {
+		// core profiles need a vertex array object, we set it up once
+		GLint current_vertex_array;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &current_vertex_array);
+
+		glGenVertexArrays(1, &vertex_array);
+		glBindVertexArray(vertex_array);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+		glBindVertexArray(current_vertex_array);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+
+	return true;
+}
+
+GLenum CopyEngine::get_texture_target(GLint p_layer, bool p_multisample) {
+	if (p_multisample) {
+		return p_layer >= 0 ? GL_TEXTURE_2D_MULTISAMPLE_ARRAY : GL_TEXTURE_2D_MULTISAMPLE;
+	}
+	return p_layer >= 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+GLenum CopyEngine::get_texture_target(const Target &p_target) {
+	return p_target.cube_map ? GL_TEXTURE_CUBE_MAP : get_texture_target(p_target.layer, p_target.multisample);
+}
+
+GLint CopyEngine::get_texture_parameter(GLuint p_texture, GLenum p_target, GLenum p_name) {
+	GLenum binding_name;
+	switch (p_target) {
+		case GL_TEXTURE_2D_ARRAY:
+			binding_name = GL_TEXTURE_BINDING_2D_ARRAY;
+			break;
+		case GL_TEXTURE_2D_MULTISAMPLE:
+			binding_name = GL_TEXTURE_BINDING_2D_MULTISAMPLE;
+			break;
+		case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+			binding_name = GL_TEXTURE_BINDING_2D_MULTISAMPLE_ARRAY;
+			break;
+		case GL_TEXTURE_CUBE_MAP:
+			binding_name = GL_TEXTURE_BINDING_CUBE_MAP;
+			break;
+		default:
+			binding_name = GL_TEXTURE_BINDING_2D;
+			break;
+	}
+
+	GLint binding;
+	glGetIntegerv(binding_name, &binding);
+
+	GLint value = 0;
+	glBindTexture(p_target, p_texture);
+	// all faces of a cube map share their format and size
+	glGetTexLevelParameteriv(p_target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : p_target, 0, p_name, &value);
+	glBindTexture(p_target, binding);
+
+	return value;
+}
+
+GLenum CopyEngine::get_texture_format(GLuint p_texture, GLenum p_target) {
+	return (GLenum)get_texture_parameter(p_texture, p_target, GL_TEXTURE_INTERNAL_FORMAT);
+}
+
+bool CopyEngine::formats_match(GLenum p_source, GLenum p_target) {
+	// glCopyImageSubData copies raw texels, only do that if they mean the same thing in both formats.
+	// Godots render target holds sRGB encoded colours so copying RGBA8 into SRGB8_ALPHA8 is what we want.
+	if (p_source == p_target) {
+		return true;
+	}
+
+	return (p_source == GL_RGBA8 || p_source == GL_SRGB8_ALPHA8) && (p_target == GL_RGBA8 || p_target == GL_SRGB8_ALPHA8);
+}
+
+bool CopyEngine::is_method_supported(Method p_method) const {
+	switch (p_method) {
+		case METHOD_COPY_IMAGE:
+			return copy_image_supported;
+		case METHOD_BLIT:
+			return blit_supported;
+		case METHOD_SHADER:
+			return true;
+		default:
+			return false;
+	}
+}
+
+CopyEngine::Method CopyEngine::select_method(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	source_format = get_texture_format(p_source, GL_TEXTURE_2D);
+	target_format = get_texture_format(p_target.texture, get_texture_target(p_target));
+
+	// glCopyImageSubData needs matching sample counts and blitting into a multisampled framebuffer is an
+	// INVALID_OPERATION, only our shader pass can replicate our texels into each sample
+	bool can_copy_image = copy_image_supported && !p_target.multisample && formats_match(source_format, target_format);
+	bool can_blit = blit_supported && !p_target.multisample;
+
+	if (requested != METHOD_AUTO) {
+		if (requested == METHOD_COPY_IMAGE && !can_copy_image) {
+			Godot::print("OpenXR can't use copy_image between formats {0} and {1}, using our shader pass", (int64_t)source_format, (int64_t)target_format);
+			return METHOD_SHADER;
+		} else if (requested == METHOD_BLIT && p_target.multisample) {
+			Godot::print("OpenXR can't blit into a multisampled swapchain, using our shader pass");
+			return METHOD_SHADER;
+		} else if (!is_method_supported(requested)) {
+			Godot::print("OpenXR copy method {0} isn't supported, using our shader pass", get_method_name(requested));
+			return METHOD_SHADER;
+		}
+		return requested;
+	}
+
+	for (size_t i = 0; i < measured.size(); i++) {
+		if (measured[i].source_format == source_format && measured[i].target_format == target_format && measured[i].multisample == p_target.multisample) {
+			return measured[i].method;
+		}
+	}
+
+	// our shader pass is all we have for multisampled targets, nothing to measure
+	if (!can_copy_image && !can_blit) {
+		return METHOD_SHADER;
+	}
+
+	// Measure each method that can do this copy on the frame we're copying anyway and keep the fastest,
+	// which one wins differs a lot between drivers. This waits for our GPU a dozen times, so we only do it
+	// once for each combination of formats.
+	Method best = METHOD_SHADER;
+	uint64_t best_usec = 0;
+	for (int m = METHOD_COPY_IMAGE; m < METHOD_MAX; m++) {
+		Method method = (Method)m;
+		if (!is_method_supported(method) || (method == METHOD_COPY_IMAGE && !can_copy_image) || (method == METHOD_BLIT && !can_blit)) {
+			continue;
+		}
+
+		uint64_t usec = measure(method, p_source, p_target, p_width, p_height, 4);
+		Godot::print("OpenXR copy method {0} took {1} usec", get_method_name(method), (int64_t)usec);
+		if (best_usec == 0 || usec < best_usec) {
+			best = method;
+			best_usec = usec;
+		}
+	}
+
+	MeasuredMethod result = { source_format, target_format, p_target.multisample, best };
+	measured.push_back(result);
+
+	return best;
+}
+
+void CopyEngine::copy(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	if (!initialised) {
+		initialise();
+	}
+
+	if (selected == METHOD_AUTO) {
+		selected = select_method(p_source, p_target, p_width, p_height);
+		Godot::print("OpenXR copying with {0} from format {1} to format {2}", get_method_name(selected), (int64_t)source_format, (int64_t)target_format);
+	}
+
+	copy_with(selected, p_source, p_target, p_width, p_height);
+}
+
+void CopyEngine::copy_with(Method p_method, GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	if (!initialised) {
+		initialise();
+	}
+
+	switch (p_method) {
+		case METHOD_COPY_IMAGE: {
+			copy_image(p_source, p_target, p_width, p_height);
+		} break;
+		case METHOD_BLIT: {
+			blit(p_source, p_target, p_width, p_height);
+		} break;
+		default: {
+			shader_pass(p_source, p_target, p_width, p_height);
+		} break;
+	}
+}
+
+void CopyEngine::copy_image(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+#ifndef WIN32
+	if (p_target.layer >= 0) {
+		// the faces of a cube map are addressed like layers
+		glCopyImageSubData(p_source, GL_TEXTURE_2D, 0, 0, 0, 0,
+				p_target.texture, get_texture_target(p_target), 0, p_target.x, 0, p_target.layer,
+				p_width, p_height, 1);
+	} else {
+		glCopyImageSubData(p_source, GL_TEXTURE_2D, 0, 0, 0, 0,
+				p_target.texture, GL_TEXTURE_2D, 0, p_target.x, 0, 0,
+				p_width, p_height, 1);
+	}
+#endif
+}
+
+void CopyEngine::bind_source(GLuint p_source) {
+	if (framebuffers[0] == 0) {
+		glGenFramebuffers(2, framebuffers);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+
+	// Godot recreates its render target whenever its size or flags change (MSAA, linear, transparency) and
+	// often gets the same texture name back, so we can't tell our attachment is stale. Attaching is cheap.
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, p_source, 0);
+}
+
+void CopyEngine::bind_target(GLenum p_attachment, GLuint p_framebuffer, const Target &p_target) {
+	if (p_target.framebuffer != 0) {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, p_target.framebuffer);
+		return;
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, p_framebuffer);
+	if (p_target.cube_map) {
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, p_attachment, GL_TEXTURE_CUBE_MAP_POSITIVE_X + p_target.layer, p_target.texture, 0);
+	} else if (p_target.layer >= 0) {
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, p_attachment, p_target.texture, 0, p_target.layer);
+	} else {
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, p_attachment, get_texture_target(-1, p_target.multisample), p_target.texture, 0);
+	}
+}
+
+void CopyEngine::blit(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	GLint read_fbo, draw_fbo;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	bind_source(p_source);
+	bind_target(GL_COLOR_ATTACHMENT0, framebuffers[1], p_target);
+
+	glBlitFramebuffer(0, 0, p_width, p_height, p_target.x, 0, p_target.x + p_width, p_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+}
+
+void CopyEngine::shader_pass(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	if (program == 0 && !create_program()) {
+		return;
+	}
+
+	// remember everything we change, Godot tracks some of this state itself
+	GLint draw_fbo, current_program, active_texture, texture, array_buffer, current_vertex_array = 0;
+	GLint viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &array_buffer);
+	if (vertex_array != 0) {
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &current_vertex_array);
+	}
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+	GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+
+	if (framebuffers[0] == 0) {
+		glGenFramebuffers(2, framebuffers);
+	}
+
+	bind_target(GL_COLOR_ATTACHMENT0, framebuffers[1], p_target);
+	glViewport(p_target.x, 0, p_width, p_height);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_CULL_FACE);
+
+	glUseProgram(program);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+	glBindTexture(GL_TEXTURE_2D, p_source);
+	glUniform1i(glGetUniformLocation(program, "source"), 0);
+
+	if (vertex_array != 0) {
+		glBindVertexArray(vertex_array);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	}
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	if (vertex_array != 0) {
+		glBindVertexArray(current_vertex_array);
+	} else {
+		glDisableVertexAttribArray(0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glActiveTexture(active_texture);
+	glUseProgram(current_program);
+
+	if (blend) {
+		glEnable(GL_BLEND);
+	}
+	if (depth_test) {
+		glEnable(GL_DEPTH_TEST);
+	}
+	if (scissor_test) {
+		glEnable(GL_SCISSOR_TEST);
+	}
+	if (cull_face) {
+		glEnable(GL_CULL_FACE);
+	}
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+}
+
+uint64_t CopyEngine::measure(Method p_method, GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height, int p_iterations) {
+	if (p_iterations < 1) {
+		p_iterations = 1;
+	}
+
+	// one copy up front so shader compilation and driver setup don't end up in our numbers
+	copy_with(p_method, p_source, p_target, p_width, p_height);
+	glFinish();
+
+	uint64_t start = OpenXRApi::get_time_usec();
+	for (int i = 0; i < p_iterations; i++) {
+		copy_with(p_method, p_source, p_target, p_width, p_height);
+		glFinish();
+	}
+
+	return (OpenXRApi::get_time_usec() - start) / p_iterations;
+}
+
+void CopyEngine::benchmark(uint32_t p_width, uint32_t p_height, GLenum p_target_format, int p_iterations, uint64_t *r_usec) {
+	if (!initialised) {
+		initialise();
+	}
+
+	GLint binding;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+
+	// our source is set up like Godots render target
+	GLuint textures[2];
+	glGenTextures(2, textures);
+	glBindTexture(GL_TEXTURE_2D, textures[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, p_width, p_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, textures[1]);
+	glTexImage2D(GL_TEXTURE_2D, 0, p_target_format, p_width, p_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, binding);
+
+	Target target = { textures[1], -1, 0, 0, false, false };
+	r_usec[METHOD_AUTO] = 0;
+	for (int m = METHOD_COPY_IMAGE; m < METHOD_MAX; m++) {
+		Method method = (Method)m;
+		if (!is_method_supported(method) || (method == METHOD_COPY_IMAGE && !formats_match(GL_RGBA8, p_target_format))) {
+			r_usec[m] = 0;
+		} else {
+			r_usec[m] = measure(method, textures[0], target, p_width, p_height, p_iterations);
+		}
+	}
+
+	glDeleteTextures(2, textures);
+}
+
+GLuint CopyEngine::find_depth_source(GLuint p_color, GLuint p_alt_color) {
+	// Godot doesn't tell us about its depth buffer, but it still has the framebuffer bound it rendered our eye into
+	GLint read_fbo, draw_fbo;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	GLuint found = 0;
+	GLint candidates[2] = { draw_fbo, read_fbo };
+	for (int i = 0; i < 2 && found == 0; i++) {
+		if (candidates[i] == 0) {
+			continue;
+		}
+
+		GLint color_type = GL_NONE, color = 0, depth_type = GL_NONE;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, candidates[i]);
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &color_type);
+		if (color_type == GL_TEXTURE) {
+			glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &color);
+		}
+		glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &depth_type);
+
+		if (depth_type != GL_NONE && color != 0 && ((GLuint)color == p_color || (GLuint)color == p_alt_color)) {
+			found = candidates[i];
+		}
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	return found;
+}
+
+bool CopyEngine::verify_depth_source(GLuint p_source_framebuffer, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	// find_depth_source() only guesses which framebuffer Godot rendered our eye with,
+	// make sure its depth buffer is single sampled and covers what we blit before we trust it
+	GLint draw_fbo;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	GLint samples = 0, depth_type = GL_NONE, depth = 0;
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, p_source_framebuffer);
+	glGetIntegerv(GL_SAMPLES, &samples);
+	glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &depth_type);
+	glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &depth);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	if (samples != 0) {
+		Godot::print("OpenXR Godots depth buffer has {0} samples, our depth swapchain has 1, not submitting depth", (int64_t)samples);
+		return false;
+	}
+
+	GLint width = 0, height = 0;
+	if (depth_type == GL_RENDERBUFFER) {
+		GLint binding;
+		glGetIntegerv(GL_RENDERBUFFER_BINDING, &binding);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+		glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+		glBindRenderbuffer(GL_RENDERBUFFER, binding);
+	} else if (depth_type == GL_TEXTURE) {
+		// single sampled and next to the 2D colour texture find_depth_source() matched, so a 2D texture as well
+		width = get_texture_parameter(depth, GL_TEXTURE_2D, GL_TEXTURE_WIDTH);
+		height = get_texture_parameter(depth, GL_TEXTURE_2D, GL_TEXTURE_HEIGHT);
+	}
+
+	GLenum target = get_texture_target(p_target);
+	GLint target_width = get_texture_parameter(p_target.texture, target, GL_TEXTURE_WIDTH);
+	GLint target_height = get_texture_parameter(p_target.texture, target, GL_TEXTURE_HEIGHT);
+
+	if (width < (GLint)p_width || height < (GLint)p_height || target_width < p_target.x + (GLint)p_width || target_height < (GLint)p_height) {
+		Godot::print("OpenXR Godots depth buffer is {0}x{1}, we need {2}x{3} for our {4}x{5} depth swapchain, not submitting depth", (int64_t)width, (int64_t)height, (int64_t)p_width, (int64_t)p_height, (int64_t)target_width, (int64_t)target_height);
+		return false;
+	}
+
+	return true;
+}
+
+bool CopyEngine::copy_depth(GLuint p_source_framebuffer, const Target &p_target, uint32_t p_width, uint32_t p_height) {
+	if (!initialised) {
+		initialise();
+	}
+
+	// we can only blit depth between matching sample counts, Godot resolves into a single sampled render target
+	if (!blit_supported || depth_failed || p_source_framebuffer == 0 || p_target.multisample) {
+		return false;
+	}
+
+	GLint read_fbo, draw_fbo;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+
+	if (depth_framebuffer == 0) {
+		glGenFramebuffers(1, &depth_framebuffer);
+	}
+
+	if (p_source_framebuffer != depth_verified_source || p_width != depth_verified_width || p_height != depth_verified_height) {
+		depth_verified = false;
+	}
+
+	if (!depth_verified) {
+		// don't blame our checks or our blit for errors that were already pending
+		while (glGetError() != GL_NO_ERROR) {
+		}
+
+		depth_verified_source = p_source_framebuffer;
+		depth_verified_width = p_width;
+		depth_verified_height = p_height;
+		if (!verify_depth_source(p_source_framebuffer, p_target, p_width, p_height)) {
+			depth_failed = true;
+			return false;
+		}
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, p_source_framebuffer);
+	bind_target(GL_DEPTH_ATTACHMENT, depth_framebuffer, p_target);
+
+	glBlitFramebuffer(0, 0, p_width, p_height, p_target.x, 0, p_target.x + p_width, p_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	if (!depth_verified) {
+		// depth blits need identical depth formats on both sides, we only find out if that's true by trying
+		GLenum error = glGetError();
+		depth_verified = true;
+		if (error != GL_NO_ERROR) {
+			Godot::print("OpenXR can't copy Godots depth buffer into our depth swapchain (GL error {0}), not submitting depth", (int64_t)error);
+			depth_failed = true;
+		}
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	return !depth_failed;
+}
+
+void CopyEngine::begin_timing() {
+	if (!initialised) {
+		initialise();
+	}
+
+	if (!timer_supported || timer_running) {
+		return;
+	}
+
+	collect_timers();
+	if (timer_count == TIMER_QUERIES) {
+		// our GPU is far behind, skip measuring rather than waiting for it
+		return;
+	}
+
+	if (timer_queries[0] == 0) {
+		glGenQueries(TIMER_QUERIES, timer_queries);
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, timer_queries[(timer_first + timer_count) % TIMER_QUERIES]);
+	timer_running = true;
+}
+
+void CopyEngine::end_timing() {
+	if (!timer_running) {
+		return;
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	timer_count++;
+	timer_running = false;
+}
+
+void CopyEngine::collect_timers() {
+	while (timer_count > 0) {
+		GLuint query = timer_queries[timer_first];
+
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			// results become available in order
+			return;
+		}
+
+		GLuint64 nsec = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nsec);
+		last_gpu_usec = nsec / 1000;
+		average_gpu_usec = timed_copies == 0 ? last_gpu_usec : average_gpu_usec * 0.95 + last_gpu_usec * 0.05;
+		timed_copies++;
+
+		timer_first = (timer_first + 1) % TIMER_QUERIES;
+		timer_count--;
+	}
+}
+
+void CopyEngine::reset_timing() {
+	last_gpu_usec = 0;
+	average_gpu_usec = 0.0;
+	timed_copies = 0;
+}
+
+void CopyEngine::cleanup() {
+	if (framebuffers[0] != 0) {
+		glDeleteFramebuffers(2, framebuffers);
+		framebuffers[0] = 0;
+		framebuffers[1] = 0;
+	}
+	if (depth_framebuffer != 0) {
+		glDeleteFramebuffers(1, &depth_framebuffer);
+		depth_framebuffer = 0;
+	}
+	depth_verified = false;
+	depth_failed = false;
+	depth_verified_source = 0;
+	depth_verified_width = 0;
+	depth_verified_height = 0;
+	if (program != 0) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+	if (vertex_buffer != 0) {
+		glDeleteBuffers(1, &vertex_buffer);
+		vertex_buffer = 0;
+	}
+	if (vertex_array != 0) {
+		glDeleteVertexArrays(1, &vertex_array);
+		vertex_array = 0;
+	}
+	if (timer_running) {
+		glEndQuery(GL_TIME_ELAPSED);
+		timer_running = false;
+	}
+	if (timer_queries[0] != 0) {
+		glDeleteQueries(TIMER_QUERIES, timer_queries);
+		for (int i = 0; i < TIMER_QUERIES; i++) {
+			timer_queries[i] = 0;
+		}
+	}
+	timer_first = 0;
+	timer_count = 0;
+
+	// our formats may change with our next session, we remember what we measured for them
+	selected = METHOD_AUTO;
+	initialised = false;
+}
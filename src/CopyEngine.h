@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Copies Godots render target into our swapchain images when Godot can't render into them directly
+
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#ifdef WIN32
+#include <glad/glad.h>
+#else
+// linux
+#define GL_GLEXT_PROTOTYPES 1
+#define GL3_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+class CopyEngine {
+public:
+	enum Method {
+		METHOD_AUTO, // pick the fastest method that works for our formats
+		METHOD_COPY_IMAGE, // glCopyImageSubData, raw copy between textures with the same texel layout
+		METHOD_BLIT, // glBlitFramebuffer between two framebuffers, converts between colour formats
+		METHOD_SHADER, // draw a fullscreen triangle sampling our source, works everywhere
+		METHOD_MAX
+	};
+
+	// Where we copy to, layer is only used for array textures and x lets us copy into half of a side by side image
+	struct Target {
+		GLuint texture;
+		GLint layer; // -1 if this is not an array texture
+		GLint x;
+		GLuint framebuffer; // prebuilt framebuffer with texture/layer attached, 0 if we should attach it ourselves
+		bool multisample; // texture is a GL_TEXTURE_2D_MULTISAMPLE(_ARRAY), only our shader pass can copy into it, it replicates each texel into every sample
+		bool cube_map; // texture is a GL_TEXTURE_CUBE_MAP and layer selects the face we copy into
+	};
+
+	enum {
+		TIMER_QUERIES = 8 // we read timer results a few frames late so we never wait on our GPU
+	};
+
+private:
+	bool initialised;
+	int gl_major;
+	bool copy_image_supported;
+	bool blit_supported;
+
+	// What auto selection measured fastest for a combination of formats, kept for as long as we live so a new
+	// session, a resize or switching back to auto doesn't measure (and hitch) again
+	struct MeasuredMethod {
+		GLenum source_format;
+		GLenum target_format;
+		bool multisample;
+		Method method;
+	};
+
+	Method requested;
+	Method selected;
+	GLenum source_format;
+	GLenum target_format;
+	std::vector<MeasuredMethod> measured;
+
+	GLuint framebuffers[2]; // read and draw framebuffer for blits and our shader pass, our source is attached on every copy
+	GLuint depth_framebuffer;
+	bool depth_verified; // we check Godots depth buffer and for errors after our first depth blit
+	bool depth_failed; // Godots depth buffer can't be blitted into our depth swapchain
+	GLuint depth_verified_source; // we verify again if Godot renders into another framebuffer or at another size
+	uint32_t depth_verified_width;
+	uint32_t depth_verified_height;
+	GLuint program;
+	GLuint vertex_buffer;
+	GLuint vertex_array;
+
+	// GPU time spent in what we copy into our swapchains, measured with GL_TIME_ELAPSED queries
+	bool timer_supported;
+	GLuint timer_queries[TIMER_QUERIES];
+	int timer_first; // oldest query we haven't read yet
+	int timer_count; // queries in flight
+	bool timer_running;
+	uint64_t last_gpu_usec;
+	double average_gpu_usec;
+	uint64_t timed_copies;
+
+	void collect_timers();
+
+	void initialise();
+	bool create_program();
+	static GLenum get_texture_target(GLint p_layer, bool p_multisample);
+	static GLenum get_texture_target(const Target &p_target);
+	static GLint get_texture_parameter(GLuint p_texture, GLenum p_target, GLenum p_name);
+	static GLenum get_texture_format(GLuint p_texture, GLenum p_target);
+	static bool formats_match(GLenum p_source, GLenum p_target);
+	void bind_source(GLuint p_source);
+	void bind_target(GLenum p_attachment, GLuint p_framebuffer, const Target &p_target);
+	Method select_method(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height);
+	bool verify_depth_source(GLuint p_source_framebuffer, const Target &p_target, uint32_t p_width, uint32_t p_height);
+
+	void copy_image(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height);
+	void blit(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height);
+	void shader_pass(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height);
+
+public:
+	CopyEngine();
+	~CopyEngine();
+
+	static bool has_extension(const char *p_name);
+	static bool is_gl_version_at_least(int p_major, int p_minor);
+
+	// Creates a framebuffer with p_texture (or one layer or cube map face of it) attached and checks it is complete, returns 0 if it isn't
+	static GLuint create_framebuffer(GLenum p_attachment, GLuint p_texture, GLint p_layer, bool p_multisample, bool p_cube_map);
+	static const char *get_method_name(Method p_method);
+
+	Method get_requested_method() const { return requested; }
+	void set_requested_method(Method p_method);
+	Method get_selected_method() const { return selected; }
+
+	// must be true before copy() is called, i.e. the method isn't unsupported by our GL context
+	bool is_method_supported(Method p_method) const;
+
+	// Copies p_width x p_height from the bottom left of p_source (a GL_TEXTURE_2D) into p_target.
+	// Must be called with our GL context current, restores the GL state it touches.
+	void copy(GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height);
+	void copy_with(Method p_method, GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height);
+
+	// Returns the average time in microseconds p_method takes for a copy, waiting for our GPU to finish each one
+	uint64_t measure(Method p_method, GLuint p_source, const Target &p_target, uint32_t p_width, uint32_t p_height, int p_iterations);
+
+	// Measures each method copying between two textures we create, r_usec is 0 for methods that can't do the copy
+	void benchmark(uint32_t p_width, uint32_t p_height, GLenum p_target_format, int p_iterations, uint64_t *r_usec);
+
+	// Returns the framebuffer Godot has bound if it renders into p_color or p_alt_color and has a depth attachment, 0 otherwise
+	static GLuint find_depth_source(GLuint p_color, GLuint p_alt_color);
+
+	// Blits the depth buffer of p_source_framebuffer into p_target, returns false if that isn't possible
+	bool copy_depth(GLuint p_source_framebuffer, const Target &p_target, uint32_t p_width, uint32_t p_height);
+
+	// Measures the GPU time of everything we do between these two, e.g. copying or resolving one eye into our swapchain
+	void begin_timing();
+	void end_timing();
+	bool is_timing_supported() const { return timer_supported; }
+	uint64_t get_last_gpu_usec() const { return last_gpu_usec; }
+	double get_average_gpu_usec() const { return average_gpu_usec; }
+	uint64_t get_timed_copies() const { return timed_copies; }
+	void reset_timing();
+
+	// Releases our GL objects, they're recreated on our next copy
+	void cleanup();
+};
+
+#endif /* !COPY_ENGINE_H */
@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Feedback controller that scales our render resolution to keep our frames within budget
+
+#include "DynamicResolution.h"
+
+#include <math.h>
+
+DynamicResolution::DynamicResolution() {
+	enabled = false;
+	min_scale = 0.5;
+	max_scale = 1.0;
+	target = 0.85;
+	step = 0.05;
+	reset();
+}
+
+void DynamicResolution::reset() {
+	scale = max_scale;
+	average_usec = 0.0;
+	frames_since_change = 0;
+	changes = 0;
+}
+
+void DynamicResolution::set_enabled(bool p_enabled) {
+	enabled = p_enabled;
+	if (!enabled) {
+		// back to full resolution
+		reset();
+	}
+}
+
+void DynamicResolution::set_min_scale(float p_scale) {
+	min_scale = p_scale < 0.1 ? 0.1 : p_scale;
+	if (min_scale > max_scale) {
+		min_scale = max_scale;
+	}
+	if (scale < min_scale) {
+		scale = min_scale;
+	}
+}
+
+void DynamicResolution::set_max_scale(float p_scale) {
+	max_scale = p_scale < 0.1 ? 0.1 : p_scale;
+	if (min_scale > max_scale) {
+		min_scale = max_scale;
+	}
+	if (scale > max_scale || !enabled) {
+		scale = max_scale;
+	}
+}
+
+void DynamicResolution::set_target(float p_target) {
+	if (p_target < 0.1) {
+		target = 0.1;
+	} else if (p_target > 1.0) {
+		target = 1.0;
+	} else {
+		target = p_target;
+	}
+}
+
+float DynamicResolution::quantize(float p_scale) const {
+	float quantized = floorf(p_scale / step + 0.5) * step;
+
+	if (quantized < min_scale) {
+		return min_scale;
+	} else if (quantized > max_scale) {
+		return max_scale;
+	} else {
+		return quantized;
+	}
+}
+
+bool DynamicResolution::update(uint64_t p_frame_usec, uint64_t p_period_usec, bool p_late) {
+	if (!enabled || p_period_usec == 0) {
+		return false;
+	}
+
+	if (average_usec == 0.0) {
+		average_usec = (double)p_frame_usec;
+	} else {
+		average_usec += ((double)p_frame_usec - average_usec) * 0.1;
+	}
+	frames_since_change++;
+
+	float new_scale = scale;
+	double budget_usec = (double)p_period_usec * target;
+
+	if (p_late) {
+		// we've already missed a frame, drop a step right away
+		new_scale = quantize(scale - step);
+	} else {
+		// our cost scales with our pixel count, which is the square of our scale
+		float desired = scale * (float)sqrt(budget_usec / average_usec);
+
+		if (desired < scale - step * 0.5) {
+			// over budget, go down right away
+			new_scale = quantize(desired);
+		} else if (desired > scale + step && frames_since_change >= SETTLE_FRAMES) {
+			// comfortably under budget and settled, go up one step at a time
+			new_scale = quantize(scale + step);
+		}
+	}
+
+	if (new_scale == scale) {
+		return false;
+	}
+
+	// predict what our frames will cost at our new scale so we don't keep reacting to old measurements
+	average_usec *= (double)(new_scale * new_scale) / (double)(scale * scale);
+
+	scale = new_scale;
+	frames_since_change = 0;
+	changes++;
+	return true;
+}
@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Feedback controller that scales our render resolution to keep our frames within budget
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <stdint.h>
+
+class DynamicResolution {
+public:
+	enum {
+		SETTLE_FRAMES = 30 // frames we wait after a change before we consider scaling up again
+	};
+
+private:
+	bool enabled;
+	float min_scale;
+	float max_scale;
+	float target; // fraction of the display period our frame work may take
+	float step; // scale is rounded to multiples of this so we don't resize Godots render target for tiny changes
+
+	float scale;
+	double average_usec; // exponential moving average of our frame work time
+	uint64_t frames_since_change;
+	uint64_t changes;
+
+	float quantize(float p_scale) const;
+
+public:
+	DynamicResolution();
+
+	bool is_enabled() const { return enabled; }
+	void set_enabled(bool p_enabled);
+
+	float get_min_scale() const { return min_scale; }
+	void set_min_scale(float p_scale);
+	float get_max_scale() const { return max_scale; }
+	void set_max_scale(float p_scale);
+	float get_target() const { return target; }
+	void set_target(float p_target);
+
+	float get_scale() const { return scale; }
+	double get_average_usec() const { return average_usec; }
+	uint64_t get_changes() const { return changes; }
+	void reset();
+
+	// Feed in how long our last frame took from xrWaitFrame until xrEndFrame and how long a display period is.
+	// p_late should be true if we missed our display time. Returns true if our scale changed.
+	bool update(uint64_t p_frame_usec, uint64_t p_period_usec, bool p_late);
+};
+
+#endif /* !DYNAMIC_RESOLUTION_H */
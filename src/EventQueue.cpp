@@ -0,0 +1,42 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Fixed size queue of OpenXR events we handle after our frame has been submitted
+
+#include "EventQueue.h"
+
+EventQueue::EventQueue() {
+	dropped = 0;
+	clear();
+}
+
+void EventQueue::clear() {
+	first = 0;
+	count = 0;
+}
+
+bool EventQueue::push(Type p_type, int64_t p_value, int64_t p_time, uint64_t p_usec) {
+	if (count == CAPACITY) {
+		dropped++;
+		return false;
+	}
+
+	Event &event = events[(first + count) % CAPACITY];
+	event.type = p_type;
+	event.value = p_value;
+	event.time = p_time;
+	event.received_usec = p_usec;
+	count++;
+
+	return true;
+}
+
+bool EventQueue::pop(Event *r_event) {
+	if (count == 0) {
+		return false;
+	}
+
+	*r_event = events[first];
+	first = (first + 1) % CAPACITY;
+	count--;
+
+	return true;
+}
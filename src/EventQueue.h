@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Fixed size queue of OpenXR events we handle after our frame has been submitted
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdint.h>
+
+class EventQueue {
+public:
+	enum Type {
+		EVENT_EVENTS_LOST, // value is the number of events the runtime dropped
+		EVENT_INSTANCE_LOSS_PENDING, // time is when our instance will be lost
+		EVENT_SESSION_STATE_CHANGED, // value is our new XrSessionState
+		EVENT_REFERENCE_SPACE_CHANGE_PENDING, // value is the XrReferenceSpaceType, time is when it changes
+		EVENT_INTERACTION_PROFILE_CHANGED, // we look up the new profiles when we handle this
+		EVENT_VISIBILITY_MASK_CHANGED, // value is the view index
+		EVENT_UNKNOWN // value is the XrStructureType we didn't recognise
+	};
+
+	struct Event {
+		Type type;
+		int64_t value;
+		int64_t time;
+		uint64_t received_usec;
+	};
+
+	enum {
+		CAPACITY = 64
+	};
+
+private:
+	// All storage is fixed so queueing never allocates
+	Event events[CAPACITY];
+	int first;
+	int count;
+	uint64_t dropped;
+
+public:
+	EventQueue();
+
+	void clear();
+
+	// Returns false and counts the event as dropped if our queue is full
+	bool push(Type p_type, int64_t p_value, int64_t p_time, uint64_t p_usec);
+	bool pop(Event *r_event);
+
+	int get_count() const { return count; }
+	uint64_t get_dropped() const { return dropped; }
+};
+
+#endif /* !EVENT_QUEUE_H */
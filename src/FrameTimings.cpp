@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Ring buffer recording when each phase of our frames happened
+
+#include "FrameTimings.h"
+
+#include <string.h>
+#include <algorithm>
+
+FrameTimings::FrameTimings() {
+	enabled = true;
+	reset();
+}
+
+void FrameTimings::reset() {
+	memset(timestamps, 0, sizeof(timestamps));
+	frames_recorded = 0;
+	current = 0;
+}
+
+void FrameTimings::start_frame(uint64_t p_usec) {
+	if (!enabled) {
+		return;
+	}
+
+	if (frames_recorded > 0) {
+		current = (current + 1) % FRAME_COUNT;
+	}
+	frames_recorded++;
+
+	memset(timestamps[current], 0, sizeof(timestamps[current]));
+	timestamps[current][PHASE_PROCESS_START] = p_usec;
+}
+
+const char *FrameTimings::get_phase_name(Phase p_phase) {
+	switch (p_phase) {
+		case PHASE_PROCESS_START:
+			return "process_start";
+		case PHASE_EVENTS_POLLED:
+			return "events_polled";
+		case PHASE_WAIT_FRAME:
+			return "wait_frame";
+		case PHASE_CONTROLLERS_UPDATED:
+			return "controllers_updated";
+		case PHASE_BEGIN_FRAME:
+			return "begin_frame";
+		case PHASE_IMAGES_ACQUIRED:
+			return "images_acquired";
+		case PHASE_COMMIT_LEFT:
+			return "commit_left";
+		case PHASE_COMMIT_RIGHT:
+			return "commit_right";
+		case PHASE_END_FRAME:
+			return "end_frame";
+		default:
+			return "unknown";
+	}
+}
+
+int FrameTimings::get_frame_count() const {
+	return frames_recorded < FRAME_COUNT ? (int)frames_recorded : FRAME_COUNT;
+}
+
+uint64_t FrameTimings::get_timestamp(int p_frame, Phase p_phase) const {
+	int count = get_frame_count();
+	if (p_frame < 0 || p_frame >= count) {
+		return 0;
+	}
+
+	// current holds our newest frame
+	int index = (current - count + 1 + p_frame + FRAME_COUNT) % FRAME_COUNT;
+	return timestamps[index][p_phase];
+}
+
+int FrameTimings::get_phase_durations(Phase p_phase, uint64_t *r_durations) const {
+	int count = get_frame_count();
+	int written = 0;
+
+	for (int f = 0; f < count; f++) {
+		uint64_t end = get_timestamp(f, p_phase);
+		if (end == 0) {
+			continue;
+		}
+
+		uint64_t start = 0;
+		if (p_phase == PHASE_PROCESS_START) {
+			start = f > 0 ? get_timestamp(f - 1, PHASE_PROCESS_START) : 0;
+		} else {
+			for (int p = p_phase - 1; p >= 0 && start == 0; p--) {
+				start = get_timestamp(f, (Phase)p);
+			}
+		}
+
+		if (start != 0 && end >= start) {
+			r_durations[written++] = end - start;
+		}
+	}
+
+	return written;
+}
+
+int FrameTimings::get_frame_durations(uint64_t *r_durations) const {
+	int count = get_frame_count();
+	int written = 0;
+
+	for (int f = 0; f < count; f++) {
+		uint64_t start = get_timestamp(f, PHASE_PROCESS_START);
+		uint64_t end = get_timestamp(f, PHASE_END_FRAME);
+		if (start != 0 && end >= start) {
+			r_durations[written++] = end - start;
+		}
+	}
+
+	return written;
+}
+
+uint64_t FrameTimings::percentile(uint64_t *p_values, int p_count, int p_percentile) {
+	if (p_count <= 0) {
+		return 0;
+	}
+
+	std::sort(p_values, p_values + p_count);
+
+	int rank = (p_percentile * p_count + 99) / 100; // ceil
+	if (rank < 1) {
+		rank = 1;
+	} else if (rank > p_count) {
+		rank = p_count;
+	}
+
+	return p_values[rank - 1];
+}
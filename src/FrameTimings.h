@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Ring buffer recording when each phase of our frames happened
+
+#ifndef FRAME_TIMINGS_H
+#define FRAME_TIMINGS_H
+
+#include <stdint.h>
+
+class FrameTimings {
+public:
+	enum Phase {
+		PHASE_PROCESS_START, // process_openxr() was called, this starts a new frame
+		PHASE_EVENTS_POLLED, // we've handled all pending events
+		PHASE_WAIT_FRAME, // xrWaitFrame returned (or we picked up a frame from our frame thread)
+		PHASE_CONTROLLERS_UPDATED, // update_controllers() finished
+		PHASE_BEGIN_FRAME, // xrBeginFrame returned
+		PHASE_IMAGES_ACQUIRED, // we acquired and waited for our swapchain images
+		PHASE_COMMIT_LEFT, // Godot committed our left eye
+		PHASE_COMMIT_RIGHT, // Godot committed our right eye
+		PHASE_END_FRAME, // xrEndFrame returned
+		PHASE_MAX
+	};
+
+	enum {
+		FRAME_COUNT = 256 // number of frames we keep
+	};
+
+private:
+	// All storage is fixed so recording never allocates, a timestamp of 0 means the phase wasn't reached that frame.
+	uint64_t timestamps[FRAME_COUNT][PHASE_MAX];
+	uint64_t frames_recorded;
+	int current;
+	bool enabled;
+
+public:
+	FrameTimings();
+
+	bool is_enabled() const { return enabled; }
+	void set_enabled(bool p_enabled) { enabled = p_enabled; }
+	void reset();
+
+	void start_frame(uint64_t p_usec);
+	void record(Phase p_phase, uint64_t p_usec) {
+		if (enabled && frames_recorded > 0) {
+			timestamps[current][p_phase] = p_usec;
+		}
+	}
+
+	static const char *get_phase_name(Phase p_phase);
+
+	// number of frames currently held, frame 0 is the oldest
+	int get_frame_count() const;
+	uint64_t get_timestamp(int p_frame, Phase p_phase) const;
+
+	// Fills r_durations with how long each frame spent in a phase, measured from the last phase
+	// recorded before it. For PHASE_PROCESS_START this is the time since the previous frame started.
+	// Returns the number of entries written, frames where the phase wasn't reached are skipped.
+	int get_phase_durations(Phase p_phase, uint64_t *r_durations) const;
+
+	// Same as above but from the start of the frame until xrEndFrame returned
+	int get_frame_durations(uint64_t *r_durations) const;
+
+	// Sorts p_values and returns the nearest rank percentile
+	static uint64_t percentile(uint64_t *p_values, int p_count, int p_percentile);
+};
+
+#endif /* !FRAME_TIMINGS_H */
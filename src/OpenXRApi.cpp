@@ -2,7 +2,11 @@
 // Helper calls and singleton container for accessing openxr
 
 #include "OpenXRApi.h"
+#include <Engine.hpp>
 #include <OS.hpp>
+#include <SceneTree.hpp>
+
+#include <chrono>
 
 using namespace godot;
 
@@ -35,15 +39,11 @@ OpenXRApi *OpenXRApi::openxr_get_api() {
 		// init openxr
 		Godot::print("OpenXR initialising OpenXR context");
 
+		// note, we don't initialise OpenXR until initialize() is called,
+		// this allows our configuration to be set up first
 		singleton = new OpenXRApi();
 		if (singleton == NULL) {
 			Godot::print_error("OpenXR init failed", __FUNCTION__, __FILE__, __LINE__);
-		} else if (!singleton->is_successful_init()) {
-			Godot::print_error("OpenXR init failed", __FUNCTION__, __FILE__, __LINE__);
-			delete singleton;
-			singleton = NULL;
-		} else {
-			Godot::print("OpenXR init succeeded");
 		}
 	}
 
@@ -159,19 +159,67 @@ bool OpenXRApi::isReferenceSpaceSupported(XrReferenceSpaceType type) {
 OpenXRApi::OpenXRApi() {
 	// we set this to true if we init everything correctly
 	successful_init = false;
+	use_count = 1;
+	running = false;
+	view_count = 0;
+	state = XR_SESSION_STATE_UNKNOWN;
+	monado_stick_on_ball_ext = false;
+
+	godot_controllers[0] = 0;
+	godot_controllers[1] = 0;
+
+	frame_thread_active = false;
+	frame_thread_slot = 0;
+	frame_thread_front = 0;
+	frame_thread_back = 1;
+	frames_ended = 0;
+	frames_begun_on_main = 0;
+	frame_thread_begin_failures = 0;
+	frames_missed = 0;
+	frame_thread_pipelined = false;
+	for (int i = 0; i < FRAME_SLOT_COUNT; i++) {
+		frame_slots[i] = {};
+	}
+}
+
+OpenXRApi::~OpenXRApi() {
+	uninitialize();
+}
+
+bool OpenXRApi::initialize() {
+	if (successful_init) {
+		// already initialised
+		return true;
+	}
 
 #ifdef WIN32
 	if (!gladLoadGL()) {
 		Godot::print_error("OpenXR Failed to initialize GLAD", __FUNCTION__, __FILE__, __LINE__);
-		return;
+		return false;
 	}
 #endif
 
-	buffer_index = NULL;
-
 	state = XR_SESSION_STATE_UNKNOWN;
-	view_pose_valid = false;
 
+	if (!create_instance()) {
+		return false;
+	}
+
+	if (!create_session()) {
+		return false;
+	}
+
+	godot_controllers[0] = arvr_api->godot_arvr_add_controller((char *)"lefthand", 1, true, true);
+	godot_controllers[1] = arvr_api->godot_arvr_add_controller((char *)"righthand", 2, true, true);
+
+	Godot::print("OpenXR initialized controllers {0} {1}", godot_controllers[0], godot_controllers[1]);
+
+	// We've made it!
+	successful_init = true;
+	return true;
+}
+
+bool OpenXRApi::create_instance() {
 	monado_stick_on_ball_ext = false;
 
 	XrResult result;
@@ -181,7 +229,7 @@ OpenXRApi::OpenXRApi() {
 
 	/* TODO: instance null will not be able to convert XrResult to string */
 	if (!xr_result(result, "Failed to enumerate number of extension properties")) {
-		return;
+		return false;
 	}
 
 	// Damn you microsoft for not supporting this!!
@@ -189,7 +237,7 @@ OpenXRApi::OpenXRApi() {
 	XrExtensionProperties *extensionProperties = (XrExtensionProperties *)malloc(sizeof(XrExtensionProperties) * extensionCount);
 	if (extensionProperties == NULL) {
 		Godot::print_error("OpenXR Couldn't allocate memory for extension properties", __FUNCTION__, __FILE__, __LINE__);
-		return;
+		return false;
 	}
 	for (uint16_t i = 0; i < extensionCount; i++) {
 		extensionProperties[i].type = XR_TYPE_EXTENSION_PROPERTIES;
@@ -199,19 +247,32 @@ OpenXRApi::OpenXRApi() {
 	result = xrEnumerateInstanceExtensionProperties(NULL, extensionCount, &extensionCount, extensionProperties);
 	if (!xr_result(result, "Failed to enumerate extension properties")) {
 		free(extensionProperties);
-		return;
+		return false;
 	}
 
 	if (!isExtensionSupported(XR_KHR_OPENGL_ENABLE_EXTENSION_NAME, extensionProperties, extensionCount)) {
 		Godot::print_error("OpenXR Runtime does not support OpenGL extension!", __FUNCTION__, __FILE__, __LINE__);
 		free(extensionProperties);
-		return;
+		return false;
 	}
 
 	if (isExtensionSupported(XR_MND_BALL_ON_STICK_EXTENSION_NAME, extensionProperties, extensionCount)) {
 		monado_stick_on_ball_ext = true;
 	}
 
+	composition_layer_depth_ext = isExtensionSupported(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME, extensionProperties, extensionCount);
+	visibility_mask_ext = isExtensionSupported(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME, extensionProperties, extensionCount);
+	composition_layer_cylinder_ext = isExtensionSupported(XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME, extensionProperties, extensionCount);
+	composition_layer_cube_ext = isExtensionSupported(XR_KHR_COMPOSITION_LAYER_CUBE_EXTENSION_NAME, extensionProperties, extensionCount);
+	composition_layer_equirect2_ext = isExtensionSupported(XR_KHR_COMPOSITION_LAYER_EQUIRECT2_EXTENSION_NAME, extensionProperties, extensionCount);
+	color_scale_bias_ext = isExtensionSupported(XR_KHR_COMPOSITION_LAYER_COLOR_SCALE_BIAS_EXTENSION_NAME, extensionProperties, extensionCount);
+
+#ifdef WIN32
+	bool convert_time_ext = isExtensionSupported(XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME, extensionProperties, extensionCount);
+#else
+	bool convert_time_ext = isExtensionSupported(XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME, extensionProperties, extensionCount);
+#endif
+
 	free(extensionProperties);
 
 	// Damn you microsoft for not supporting this!!
@@ -219,7 +280,7 @@ OpenXRApi::OpenXRApi() {
 	const char **enabledExtensions = (const char **)malloc(sizeof(const char *) * extensionCount);
 	if (enabledExtensions == NULL) {
 		Godot::print_error("OpenXR Couldn't allocate memory to record enabled extensions", __FUNCTION__, __FILE__, __LINE__);
-		return;
+		return false;
 	}
 
 	uint32_t enabledExtensionCount = 0;
@@ -229,6 +290,42 @@ OpenXRApi::OpenXRApi() {
 		enabledExtensions[enabledExtensionCount++] = XR_MND_BALL_ON_STICK_EXTENSION_NAME;
 	}
 
+	if (composition_layer_depth_ext) {
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME;
+	}
+
+	if (visibility_mask_ext) {
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_VISIBILITY_MASK_EXTENSION_NAME;
+	}
+
+	if (composition_layer_cylinder_ext) {
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME;
+	}
+	composition_layers.set_shape_supported(CompositionLayers::SHAPE_CYLINDER, composition_layer_cylinder_ext);
+
+	if (composition_layer_cube_ext) {
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_COMPOSITION_LAYER_CUBE_EXTENSION_NAME;
+	}
+	composition_layers.set_shape_supported(CompositionLayers::SHAPE_CUBE, composition_layer_cube_ext);
+
+	if (composition_layer_equirect2_ext) {
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_COMPOSITION_LAYER_EQUIRECT2_EXTENSION_NAME;
+	}
+	composition_layers.set_shape_supported(CompositionLayers::SHAPE_EQUIRECT, composition_layer_equirect2_ext);
+
+	if (color_scale_bias_ext) {
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_COMPOSITION_LAYER_COLOR_SCALE_BIAS_EXTENSION_NAME;
+	}
+	composition_layers.set_color_scale_bias_supported(color_scale_bias_ext);
+
+	if (convert_time_ext) {
+#ifdef WIN32
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_WIN32_CONVERT_PERFORMANCE_COUNTER_TIME_EXTENSION_NAME;
+#else
+		enabledExtensions[enabledExtensionCount++] = XR_KHR_CONVERT_TIMESPEC_TIME_EXTENSION_NAME;
+#endif
+	}
+
 // https://stackoverflow.com/a/55926503
 #if defined(__GNUC__) && !defined(__llvm__) && !defined(__INTEL_COMPILER)
 #define __GCC__
@@ -265,43 +362,33 @@ OpenXRApi::OpenXRApi() {
 	result = xrCreateInstance(&instanceCreateInfo, &instance);
 	if (!xr_result(result, "Failed to create XR instance.")) {
 		free(enabledExtensions);
-		return;
+		return false;
 	}
 	free(enabledExtensions);
 
-	// TODO: Support AR?
-	XrSystemGetInfo systemGetInfo = {
-		.type = XR_TYPE_SYSTEM_GET_INFO,
-		.next = NULL,
-		.formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY,
-	};
-
-	XrSystemId systemId;
-	result = xrGetSystem(instance, &systemGetInfo, &systemId);
-	if (!xr_result(result, "Failed to get system for HMD form factor.")) {
-		return;
+	if (convert_time_ext) {
+#ifdef WIN32
+		result = xrGetInstanceProcAddr(instance, "xrConvertTimeToWin32PerformanceCounterKHR", (PFN_xrVoidFunction *)&xrConvertTimeToWin32PerformanceCounterKHR_ptr);
+#else
+		result = xrGetInstanceProcAddr(instance, "xrConvertTimeToTimespecTimeKHR", (PFN_xrVoidFunction *)&xrConvertTimeToTimespecTimeKHR_ptr);
+#endif
+		// not fatal, we just can't tell whether our frames are late
+		xr_result(result, "Failed to get time conversion function pointer");
 	}
 
-	XrSystemProperties systemProperties = {
-		.type = XR_TYPE_SYSTEM_PROPERTIES,
-		.next = NULL,
-		.graphicsProperties = { 0 },
-		.trackingProperties = { 0 },
-	};
-	result = xrGetSystemProperties(instance, systemId, &systemProperties);
-	if (!xr_result(result, "Failed to get System properties")) {
-		return;
+	if (!get_system()) {
+		return false;
 	}
 
 	XrViewConfigurationType viewConfigType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
 	if (!isViewConfigSupported(viewConfigType, systemId)) {
 		Godot::print_error("OpenXR Stereo View Configuration not supported!", __FUNCTION__, __FILE__, __LINE__);
-		return;
+		return false;
 	}
 
 	result = xrEnumerateViewConfigurationViews(instance, systemId, viewConfigType, 0, &view_count, NULL);
 	if (!xr_result(result, "Failed to get view configuration view count!")) {
-		return;
+		return false;
 	}
 
 	configuration_views = (XrViewConfigurationView *)malloc(sizeof(XrViewConfigurationView) * view_count);
@@ -312,15 +399,11 @@ OpenXRApi::OpenXRApi() {
 
 	result = xrEnumerateViewConfigurationViews(instance, systemId, viewConfigType, view_count, &view_count, configuration_views);
 	if (!xr_result(result, "Failed to enumerate view configuration views!")) {
-		return;
+		return false;
 	}
 
 	buffer_index = (uint32_t *)malloc(sizeof(uint32_t) * view_count);
 
-	if (!check_graphics_requirements_gl(systemId)) {
-		return;
-	}
-
 	// TODO: support wayland
 	// TODO: maybe support xcb separately?
 	// TODO: support vulkan
@@ -328,7 +411,7 @@ OpenXRApi::OpenXRApi() {
 	OS *os = OS::get_singleton();
 
 	// this will be 0 for GLES3, 1 for GLES2, not sure yet for Vulkan.
-	int video_driver = os->get_current_video_driver();
+	video_driver = os->get_current_video_driver();
 
 #ifdef WIN32
 	graphics_binding_gl = XrGraphicsBindingOpenGLWin32KHR{
@@ -341,7 +424,7 @@ OpenXRApi::OpenXRApi() {
 
 	if ((graphics_binding_gl.hDC == 0) || (graphics_binding_gl.hGLRC == 0)) {
 		Godot::print_error("OpenXR Windows native handle API is missing, please use a newer version of Godot!", __FUNCTION__, __FILE__, __LINE__);
-		return;
+		return false;
 	}
 
 #else
@@ -384,227 +467,53 @@ OpenXRApi::OpenXRApi() {
 	Godot::print("OpenXR Using OpenGL version: {0}", (char *)glGetString(GL_VERSION));
 	Godot::print("OpenXR Using OpenGL renderer: {0}", (char *)glGetString(GL_RENDERER));
 
-	XrSessionCreateInfo session_create_info = {
-		.type = XR_TYPE_SESSION_CREATE_INFO,
-		.next = &graphics_binding_gl,
-		.systemId = systemId
-	};
-
-	result = xrCreateSession(instance, &session_create_info, &session);
-	if (!xr_result(result, "Failed to create session")) {
-		return;
-	}
-
-	XrPosef identityPose = {
-		.orientation = { .x = 0, .y = 0, .z = 0, .w = 1.0 },
-		.position = { .x = 0, .y = 0, .z = 0 }
-	};
-
-	{
-		// most runtimes will support local and stage
-		if (!isReferenceSpaceSupported(play_space_type)) {
-			Godot::print("OpenXR runtime does not support play space type {0}!", play_space_type);
-			return;
-		}
-
-		XrReferenceSpaceCreateInfo localSpaceCreateInfo = {
-			.type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO,
-			.next = NULL,
-			.referenceSpaceType = play_space_type,
-			.poseInReferenceSpace = identityPose
-		};
-
-		result = xrCreateReferenceSpace(session, &localSpaceCreateInfo, &play_space);
-		if (!xr_result(result, "Failed to create local space!")) {
-			return;
-		}
-	}
-
-	{
-		// all runtimes should support this
-		if (!isReferenceSpaceSupported(XR_REFERENCE_SPACE_TYPE_VIEW)) {
-			Godot::print_error("OpenXR runtime does not support view space!", __FUNCTION__, __FILE__, __LINE__);
-			return;
-		}
-
-		XrReferenceSpaceCreateInfo view_space_create_info = {
-			.type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO,
-			.next = NULL,
-			.referenceSpaceType = XR_REFERENCE_SPACE_TYPE_VIEW,
-			.poseInReferenceSpace = identityPose
-		};
-
-		result = xrCreateReferenceSpace(session, &view_space_create_info, &view_space);
-		if (!xr_result(result, "Failed to create local space!")) {
-			return;
-		}
-	}
-
-	XrSessionBeginInfo sessionBeginInfo = {
-		.type = XR_TYPE_SESSION_BEGIN_INFO,
-		.next = NULL,
-		.primaryViewConfigurationType = viewConfigType
-	};
-	result = xrBeginSession(session, &sessionBeginInfo);
-	if (!xr_result(result, "Failed to begin session!")) {
-		return;
-	}
-
-	uint32_t swapchainFormatCount;
-	result = xrEnumerateSwapchainFormats(session, 0, &swapchainFormatCount, NULL);
-	if (!xr_result(result, "Failed to get number of supported swapchain formats")) {
-		return;
-	}
-
-	// Damn you microsoft for not supporting this!!
-	// int64_t swapchainFormats[swapchainFormatCount];
-	int64_t *swapchainFormats = (int64_t *)malloc(sizeof(int64_t) * swapchainFormatCount);
-	if (swapchainFormats == NULL) {
-		Godot::print_error("OpenXR Couldn't allocate memory for swap chain formats", __FUNCTION__, __FILE__, __LINE__);
-		return;
-	}
-
-	result = xrEnumerateSwapchainFormats(session, swapchainFormatCount, &swapchainFormatCount, swapchainFormats);
-	if (!xr_result(result, "Failed to enumerate swapchain formats")) {
-		free(swapchainFormats);
-		return;
-	}
-
-	// int64_t swapchainFormatToUse = swapchainFormats[0];
-	int64_t swapchainFormatToUse = 0;
-
-	// With the GLES2 driver we're rendering directly into this buffer with a pipeline that assumes an RGBA8 buffer.
-	// With the GLES3 driver rendering happens into an RGBA16F buffer with all rendering happening in linear color space.
-	// This buffer is then copied into the texture we supply here during the post process stage where tone mapping, glow, DOF, screenspace reflection and conversion to sRGB is applied.
-	// As such we should chose an RGBA8 buffer here (note that an SRGB variant would allow automatic Linear to SRGB conversion but not sure if that is actually used)
-
-	// We grab the first applicable one we find, OpenXR sorts these from best to worst choice..
-
-	Godot::print("OpenXR Swapchain Formats");
-	for (uint32_t i = 0; i < swapchainFormatCount && swapchainFormatToUse == 0; i++) {
-		// printf("Found %llX\n", swapchainFormats[i]);
-#ifdef WIN32
-		if (swapchainFormats[i] == GL_SRGB8_ALPHA8) {
-			swapchainFormatToUse = swapchainFormats[i];
-			Godot::print("OpenXR Using SRGB swapchain.");
-		}
-		if (swapchainFormats[i] == GL_RGBA8) {
-			swapchainFormatToUse = swapchainFormats[i];
-			Godot::print("OpenXR Using RGBA swapchain.");
-		}
-#else
-		if (swapchainFormats[i] == GL_SRGB8_ALPHA8_EXT) {
-			swapchainFormatToUse = swapchainFormats[i];
-			Godot::print("OpenXR Using SRGB swapchain.");
-		}
-		if (swapchainFormats[i] == GL_RGBA8_EXT) {
-			swapchainFormatToUse = swapchainFormats[i];
-			Godot::print("OpenXR Using RGBA swapchain.");
-		}
-#endif
-	}
-
-	// Couldn't find any we want? use the first one.
-	// If this is a RGBA16F texture OpenXR on Steam atleast expects linear color space and we'll end up with a too bright display
-	if (swapchainFormatToUse == 0) {
-		swapchainFormatToUse = swapchainFormats[0];
-		Godot::print("OpenXR Couldn't find prefered swapchain format, using %llX", swapchainFormatToUse);
-	}
-
-	free(swapchainFormats);
-
-	swapchains = (XrSwapchain *)malloc(sizeof(XrSwapchain) * view_count);
-
-	// Damn you microsoft for not supporting this!!
-	//uint32_t swapchainLength[view_count];
-	uint32_t *swapchainLength = (uint32_t *)malloc(sizeof(uint32_t) * view_count);
-	for (uint32_t i = 0; i < view_count; i++) {
-		// again Microsoft wants these in order!
-		XrSwapchainCreateInfo swapchainCreateInfo = {
-			.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
-			.next = NULL,
-			.createFlags = 0,
-			.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
-			.format = swapchainFormatToUse,
-			.sampleCount = configuration_views->recommendedSwapchainSampleCount, // 1,
-			.width = configuration_views[i].recommendedImageRectWidth,
-			.height = configuration_views[i].recommendedImageRectHeight,
-			.faceCount = 1,
-			.arraySize = 1,
-			.mipCount = 1,
-		};
-
-		result = xrCreateSwapchain(session, &swapchainCreateInfo, &swapchains[i]);
-		if (!xr_result(result, "Failed to create swapchain {0}!", i)) {
-			free(swapchainLength);
-			return;
-		}
-
-		result = xrEnumerateSwapchainImages(swapchains[i], 0, &swapchainLength[i], NULL);
-		if (!xr_result(result, "Failed to enumerate swapchains")) {
-			free(swapchainLength);
-			return;
-		}
-	}
-
-	images = (XrSwapchainImageOpenGLKHR **)malloc(sizeof(XrSwapchainImageOpenGLKHR **) * view_count);
-	for (uint32_t i = 0; i < view_count; i++) {
-		images[i] = (XrSwapchainImageOpenGLKHR *)malloc(sizeof(XrSwapchainImageOpenGLKHR) * swapchainLength[i]);
-
-		for (uint32_t j = 0; j < swapchainLength[i]; j++) {
-			images[i][j].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR;
-			images[i][j].next = NULL;
-		}
-	}
-
-	for (uint32_t i = 0; i < view_count; i++) {
-		result = xrEnumerateSwapchainImages(swapchains[i], swapchainLength[i], &swapchainLength[i], (XrSwapchainImageBaseHeader *)images[i]);
-		if (!xr_result(result, "Failed to enumerate swapchain images")) {
-			return;
-		}
-	}
-
-	free(swapchainLength);
-
-	// only used for OpenGL depth testing
-	/*
-	glGenTextures(1, &depthbuffer);
-	glBindTexture(GL_TEXTURE_2D, depthbuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24,
-		configuration_views[0].recommendedImageRectWidth,
-		configuration_views[0].recommendedImageRectHeight, 0,
-		GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 0);
-	*/
-
 	projectionLayer = (XrCompositionLayerProjection *)malloc(sizeof(XrCompositionLayerProjection));
 	projectionLayer->type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
 	projectionLayer->next = NULL;
 	projectionLayer->layerFlags = 0;
-	projectionLayer->space = play_space;
+	projectionLayer->space = XR_NULL_HANDLE; // set in create_session()
 	projectionLayer->viewCount = view_count;
 	projectionLayer->views = NULL;
 
 	frameState.type = XR_TYPE_FRAME_STATE;
 	frameState.next = NULL;
 
-	running = true;
-
-	views = (XrView *)malloc(sizeof(XrView) * view_count);
+	tracking.views = (XrView *)malloc(sizeof(XrView) * view_count);
+	late_latch_views = (XrView *)malloc(sizeof(XrView) * view_count);
 	projection_views = (XrCompositionLayerProjectionView *)malloc(sizeof(XrCompositionLayerProjectionView) * view_count);
+	depth_infos = (XrCompositionLayerDepthInfoKHR *)malloc(sizeof(XrCompositionLayerDepthInfoKHR) * view_count);
 	for (uint32_t i = 0; i < view_count; i++) {
-		views[i].type = XR_TYPE_VIEW;
-		views[i].next = NULL;
+		tracking.views[i].type = XR_TYPE_VIEW;
+		tracking.views[i].next = NULL;
+
+		late_latch_views[i].type = XR_TYPE_VIEW;
+		late_latch_views[i].next = NULL;
 
 		projection_views[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
 		projection_views[i].next = NULL;
-		projection_views[i].subImage.swapchain = swapchains[i];
+		projection_views[i].subImage.swapchain = XR_NULL_HANDLE; // set in create_session()
 		projection_views[i].subImage.imageArrayIndex = 0;
 		projection_views[i].subImage.imageRect.offset.x = 0;
 		projection_views[i].subImage.imageRect.offset.y = 0;
-		projection_views[i].subImage.imageRect.extent.width = configuration_views[i].recommendedImageRectWidth;
-		projection_views[i].subImage.imageRect.extent.height = configuration_views[i].recommendedImageRectHeight;
+		projection_views[i].subImage.imageRect.extent.width = render_width;
+		projection_views[i].subImage.imageRect.extent.height = render_height;
+
+		// Godot uses the default depth range, near and far are updated in fill_projection_matrix()
+		depth_infos[i].type = XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR;
+		depth_infos[i].next = NULL;
+		depth_infos[i].subImage = projection_views[i].subImage;
+		depth_infos[i].minDepth = 0.0;
+		depth_infos[i].maxDepth = 1.0;
+		depth_infos[i].nearZ = 0.05;
+		depth_infos[i].farZ = 100.0;
 	};
 
+	if (visibility_mask_ext) {
+		// not fatal, we just won't have visibility masks
+		result = visibility_mask.setup(instance, view_count);
+		xr_result(result, "Failed to get visibility mask function pointer");
+	}
+
 	XrActionSetCreateInfo actionSetInfo = {
 		.type = XR_TYPE_ACTION_SET_CREATE_INFO,
 		.next = NULL,
@@ -615,7 +524,7 @@ OpenXRApi::OpenXRApi() {
 
 	result = xrCreateActionSet(instance, &actionSetInfo, &actionSet);
 	if (!xr_result(result, "failed to create actionset")) {
-		return;
+		return false;
 	}
 
 	xrStringToPath(instance, "/user/hand/left", &handPaths[HAND_LEFT]);
@@ -624,34 +533,34 @@ OpenXRApi::OpenXRApi() {
 	// TODO: add action editor to godot and create actions dynamically
 	actions[TRIGGER_ACTION_INDEX] = createAction(XR_ACTION_TYPE_FLOAT_INPUT, "trigger", "Trigger Button");
 	if (actions[TRIGGER_ACTION_INDEX] == NULL) {
-		return;
+		return false;
 	}
 
 	actions[GRAB_ACTION_INDEX] = createAction(XR_ACTION_TYPE_BOOLEAN_INPUT, "grab", "Grab Button");
 	if (actions[GRAB_ACTION_INDEX] == NULL) {
-		return;
+		return false;
 	}
 
 	actions[MENU_ACTION_INDEX] = createAction(XR_ACTION_TYPE_BOOLEAN_INPUT, "menu", "Menu Button");
 	if (actions[GRAB_ACTION_INDEX] == NULL) {
-		return;
+		return false;
 	}
 
 	actions[POSE_ACTION_INDEX] = createAction(XR_ACTION_TYPE_POSE_INPUT, "handpose", "Hand Pose");
 	if (actions[POSE_ACTION_INDEX] == NULL) {
-		return;
+		return false;
 	}
 
 	actions[THUMBSTICK_X_AXIS_ACTION_INDEX] = createAction(XR_ACTION_TYPE_FLOAT_INPUT, "thumbstick_x", "Thumbstick X Axis");
 	if (actions[THUMBSTICK_X_AXIS_ACTION_INDEX] == NULL) {
 		Godot::print("Failed to create the Thumbstick X Axis action.");
-		return;
+		return false;
 	}
 
 	actions[THUMBSTICK_Y_AXIS_ACTION_INDEX] = createAction(XR_ACTION_TYPE_FLOAT_INPUT, "thumbstick_y", "Thumbstick Y Axis");
 	if (actions[THUMBSTICK_Y_AXIS_ACTION_INDEX] == NULL) {
 		Godot::print("Failed to create the Thumbstick Y Axis action.");
-		return;
+		return false;
 	}
 
 	XrPath selectClickPath[HANDCOUNT];
@@ -692,7 +601,7 @@ OpenXRApi::OpenXRApi() {
 		XrPath *paths[] = { aimPosePath, selectClickPath };
 		int num_actions = sizeof(actions) / sizeof(actions[0]);
 		if (!suggestActions("/interaction_profiles/khr/simple_controller", actions, paths, num_actions)) {
-			return;
+			return false;
 		}
 	}
 
@@ -709,7 +618,7 @@ OpenXRApi::OpenXRApi() {
 		XrPath *paths[] = { aimPosePath, triggerPath, aPath, bPath, thumbstickXAxisPath, thumbstickYAxisPath };
 		int const num_actions = sizeof(actions) / sizeof(actions[0]);
 		if (!suggestActions("/interaction_profiles/valve/index_controller", actions, paths, num_actions)) {
-			return;
+			return false;
 		}
 	}
 
@@ -719,84 +628,1018 @@ OpenXRApi::OpenXRApi() {
 		xrStringToPath(instance, "/user/hand/left/input/square_mndx/click", &squarePath[HAND_LEFT]);
 		xrStringToPath(instance, "/user/hand/right/input/square_mndx/click", &squarePath[HAND_RIGHT]);
 
-		XrAction actions[] = {
-			this->actions[POSE_ACTION_INDEX],
-			this->actions[TRIGGER_ACTION_INDEX],
-			this->actions[GRAB_ACTION_INDEX],
-			this->actions[MENU_ACTION_INDEX],
+		XrAction actions[] = {
+			this->actions[POSE_ACTION_INDEX],
+			this->actions[TRIGGER_ACTION_INDEX],
+			this->actions[GRAB_ACTION_INDEX],
+			this->actions[MENU_ACTION_INDEX],
+		};
+		XrPath *paths[] = { aimPosePath, triggerPath, squarePath, menuPath };
+		int num_actions = sizeof(actions) / sizeof(actions[0]);
+		if (!suggestActions("/interaction_profiles/mndx/ball_on_a_stick_controller", actions, paths, num_actions)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool OpenXRApi::create_session() {
+	// Everything here belongs to our session, this is recreated when we recover from losing our session.
+	XrResult result;
+
+	XrSessionCreateInfo session_create_info = {
+		.type = XR_TYPE_SESSION_CREATE_INFO,
+		.next = &graphics_binding_gl,
+		.systemId = systemId
+	};
+
+	result = xrCreateSession(instance, &session_create_info, &session);
+	if (!xr_result(result, "Failed to create session")) {
+		return false;
+	}
+
+	XrPosef identityPose = {
+		.orientation = { .x = 0, .y = 0, .z = 0, .w = 1.0 },
+		.position = { .x = 0, .y = 0, .z = 0 }
+	};
+
+	{
+		// most runtimes will support local and stage
+		if (!isReferenceSpaceSupported(play_space_type)) {
+			Godot::print("OpenXR runtime does not support play space type {0}!", play_space_type);
+			return false;
+		}
+
+		XrReferenceSpaceCreateInfo localSpaceCreateInfo = {
+			.type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO,
+			.next = NULL,
+			.referenceSpaceType = play_space_type,
+			.poseInReferenceSpace = identityPose
+		};
+
+		result = xrCreateReferenceSpace(session, &localSpaceCreateInfo, &play_space);
+		if (!xr_result(result, "Failed to create local space!")) {
+			return false;
+		}
+	}
+
+	{
+		// all runtimes should support this
+		if (!isReferenceSpaceSupported(XR_REFERENCE_SPACE_TYPE_VIEW)) {
+			Godot::print_error("OpenXR runtime does not support view space!", __FUNCTION__, __FILE__, __LINE__);
+			return false;
+		}
+
+		XrReferenceSpaceCreateInfo view_space_create_info = {
+			.type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO,
+			.next = NULL,
+			.referenceSpaceType = XR_REFERENCE_SPACE_TYPE_VIEW,
+			.poseInReferenceSpace = identityPose
+		};
+
+		result = xrCreateReferenceSpace(session, &view_space_create_info, &view_space);
+		if (!xr_result(result, "Failed to create local space!")) {
+			return false;
+		}
+	}
+
+	uint32_t swapchainFormatCount;
+	result = xrEnumerateSwapchainFormats(session, 0, &swapchainFormatCount, NULL);
+	if (!xr_result(result, "Failed to get number of supported swapchain formats")) {
+		return false;
+	}
+
+	// Damn you microsoft for not supporting this!!
+	// int64_t swapchainFormats[swapchainFormatCount];
+	// This outlives several early returns below, a vector frees itself on all of them.
+	std::vector<int64_t> swapchainFormats(swapchainFormatCount);
+	result = xrEnumerateSwapchainFormats(session, swapchainFormatCount, &swapchainFormatCount, swapchainFormats.data());
+	if (!xr_result(result, "Failed to enumerate swapchain formats")) {
+		return false;
+	} else if (swapchainFormatCount == 0) {
+		Godot::print_error("OpenXR runtime doesn't offer any swapchain formats", __FUNCTION__, __FILE__, __LINE__);
+		return false;
+	}
+
+	// Allocate our swapchains at our maximum render scale once, dynamic resolution only changes how much of them we use.
+	// Godot renders both eyes at the same size so we size everything from our first view.
+	float max_scale = dynamic_resolution.get_max_scale();
+	swapchain_width = (uint32_t)(configuration_views[0].recommendedImageRectWidth * max_scale + 0.5);
+	swapchain_height = (uint32_t)(configuration_views[0].recommendedImageRectHeight * max_scale + 0.5);
+	if (swapchain_width > configuration_views[0].maxImageRectWidth) {
+		swapchain_width = configuration_views[0].maxImageRectWidth;
+	}
+	if (swapchain_height > configuration_views[0].maxImageRectHeight) {
+		swapchain_height = configuration_views[0].maxImageRectHeight;
+	}
+	Godot::print("OpenXR swapchain size {0}x{1} (recommended {2}x{3})", swapchain_width, swapchain_height, configuration_views[0].recommendedImageRectWidth, configuration_views[0].recommendedImageRectHeight);
+
+	dynamic_resolution.reset();
+	update_render_size();
+
+	// Either one swapchain per view, or a single swapchain with a layer per view or our views side by side
+	swapchain_layout = swapchain_layout_setting;
+	swapchain_count = swapchain_layout == SWAPCHAIN_LAYOUT_PER_VIEW ? view_count : 1;
+	uint32_t array_size = swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY ? view_count : 1;
+	uint32_t image_width = swapchain_layout == SWAPCHAIN_LAYOUT_SIDE_BY_SIDE ? swapchain_width * view_count : swapchain_width;
+	setup_sample_counts();
+
+	// With the GLES2 driver we're rendering directly into this buffer with a pipeline that assumes an RGBA8 buffer.
+	// With the GLES3 driver rendering happens into an RGBA16F buffer with all rendering happening in linear color space.
+	// This buffer is then copied into the texture we supply here during the post process stage where tone mapping, glow, DOF, screenspace reflection and conversion to sRGB is applied.
+	// Our policy picks the first of our preferred formats the runtime supports, for the linear float formats
+	// we have Godot skip its conversion to sRGB so the runtime gets the linear colour it expects.
+	// That only works if Godot renders straight into our swapchain, when we copy from Godots own render target
+	// its linear output has already been stored in 8 or 10 bits and bands, so we only consider linear formats if
+	// Godot can render into our images directly (see get_external_texture_for_eye()).
+	SwapchainFormatPolicy::Driver driver = video_driver == 1 ? SwapchainFormatPolicy::DRIVER_GLES2 : SwapchainFormatPolicy::DRIVER_GLES3;
+	uint64_t pixels_per_frame = (uint64_t)image_width * swapchain_height * array_size * swapchain_count;
+	bool allow_linear = swapchain_layout == SWAPCHAIN_LAYOUT_PER_VIEW;
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		allow_linear = allow_linear && !is_multisampled(i);
+	}
+
+	Godot::print("OpenXR Swapchain Formats{0}", allow_linear ? "" : " (copying from Godots render target, skipping linear formats)");
+	SwapchainFormatPolicy::Format candidates[SwapchainFormatPolicy::FORMAT_MAX];
+	int candidate_count = format_policy.get_candidates(driver, allow_linear, candidates);
+	for (int c = 0; c < candidate_count; c++) {
+		const SwapchainFormatPolicy::FormatInfo &info = SwapchainFormatPolicy::get_info(candidates[c]);
+		bool supported = false;
+		for (uint32_t i = 0; i < swapchainFormatCount && !supported; i++) {
+			supported = swapchainFormats[i] == info.gl_format;
+		}
+		Godot::print("OpenXR   {0}: {1} bytes per frame{2}", info.name, (int64_t)(pixels_per_frame * info.bytes_per_pixel), supported ? "" : " (not supported by runtime)");
+	}
+
+	SwapchainFormatPolicy::Format chosen;
+	int format_index = format_policy.select(driver, allow_linear, swapchainFormats.data(), swapchainFormatCount, &chosen);
+	if (format_index >= 0) {
+		const SwapchainFormatPolicy::FormatInfo &info = SwapchainFormatPolicy::get_info(chosen);
+		swapchain_format = info.gl_format;
+		swapchain_bytes_per_frame = pixels_per_frame * info.bytes_per_pixel;
+		linear_output_pending = info.linear;
+		Godot::print("OpenXR Using {0} swapchain, {1} bytes per frame", info.name, (int64_t)swapchain_bytes_per_frame);
+	} else {
+		// Couldn't find any we want? use the first one.
+		// If this is a RGBA16F texture OpenXR on Steam atleast expects linear color space and we'll end up with a too bright display
+		swapchain_format = swapchainFormats[0];
+		swapchain_bytes_per_frame = 0;
+		linear_output_pending = false;
+		Godot::print("OpenXR Couldn't find prefered swapchain format, using %llX", swapchain_format);
+	}
+	composition_layers.select_format(swapchainFormats.data(), swapchainFormatCount, swapchain_format);
+
+	swapchains = (XrSwapchain *)malloc(sizeof(XrSwapchain) * swapchain_count);
+	image_counts = (uint32_t *)malloc(sizeof(uint32_t) * swapchain_count);
+	image_acquired = (bool *)malloc(sizeof(bool) * swapchain_count);
+	image_waited = (bool *)malloc(sizeof(bool) * swapchain_count);
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		swapchains[i] = XR_NULL_HANDLE;
+		image_counts[i] = 0;
+		image_acquired[i] = false;
+		image_waited[i] = false;
+	}
+
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		// again Microsoft wants these in order!
+		XrSwapchainCreateInfo swapchainCreateInfo = {
+			.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+			.next = NULL,
+			.createFlags = 0,
+			.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
+			.format = swapchain_format,
+			.sampleCount = swapchain_sample_counts[i],
+			.width = image_width,
+			.height = swapchain_height,
+			.faceCount = 1,
+			.arraySize = array_size,
+			.mipCount = 1,
+		};
+
+		result = xrCreateSwapchain(session, &swapchainCreateInfo, &swapchains[i]);
+		if (!xr_result(result, "Failed to create swapchain {0}!", i)) {
+			return false;
+		}
+
+		result = xrEnumerateSwapchainImages(swapchains[i], 0, &image_counts[i], NULL);
+		if (!xr_result(result, "Failed to enumerate swapchains")) {
+			return false;
+		}
+	}
+
+	images = (XrSwapchainImageOpenGLKHR **)malloc(sizeof(XrSwapchainImageOpenGLKHR **) * swapchain_count);
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		images[i] = (XrSwapchainImageOpenGLKHR *)malloc(sizeof(XrSwapchainImageOpenGLKHR) * image_counts[i]);
+
+		for (uint32_t j = 0; j < image_counts[i]; j++) {
+			images[i][j].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR;
+			images[i][j].next = NULL;
+		}
+	}
+
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		result = xrEnumerateSwapchainImages(swapchains[i], image_counts[i], &image_counts[i], (XrSwapchainImageBaseHeader *)images[i]);
+		if (!xr_result(result, "Failed to enumerate swapchain images")) {
+			return false;
+		}
+	}
+
+	if (swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY && !is_multisampled(0)) {
+		create_layer_textures();
+	}
+
+	if (use_depth_setting) {
+		if (!composition_layer_depth_ext) {
+			Godot::print("OpenXR runtime doesn't support XR_KHR_composition_layer_depth, not submitting depth");
+		} else if (is_multisampled(0)) {
+			// Godots depth buffer has its own sample count, blitting it into ours fails
+			Godot::print("OpenXR can't copy depth into native MSAA swapchains, not submitting depth");
+		} else if (!create_depth_swapchains(swapchainFormats.data(), swapchainFormatCount, array_size, image_width)) {
+			return false;
+		}
+	}
+
+	create_framebuffers();
+
+	// fences need GL 3.2 or ARB_sync
+	if (CopyEngine::is_gl_version_at_least(3, 2) || CopyEngine::has_extension("GL_ARB_sync")) {
+		release_fences = (GLsync *)malloc(sizeof(GLsync) * swapchain_count);
+		for (uint32_t i = 0; i < swapchain_count; i++) {
+			release_fences[i] = 0;
+		}
+	}
+
+	projectionLayer->space = play_space;
+	for (uint32_t i = 0; i < view_count; i++) {
+		projection_views[i].subImage.swapchain = swapchains[get_swapchain_for_eye(i)];
+		projection_views[i].subImage.imageArrayIndex = swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY ? i : 0;
+		projection_views[i].subImage.imageRect.offset.x = swapchain_layout == SWAPCHAIN_LAYOUT_SIDE_BY_SIDE ? i * swapchain_width : 0;
+		projection_views[i].next = NULL;
+
+		if (depth_swapchains != NULL) {
+			depth_infos[i].subImage = projection_views[i].subImage;
+			depth_infos[i].subImage.swapchain = depth_swapchains[get_swapchain_for_eye(i)];
+		}
+	}
+
+	XrActionSpaceCreateInfo actionSpaceInfo = {
+		.type = XR_TYPE_ACTION_SPACE_CREATE_INFO,
+		.next = NULL,
+		.action = actions[POSE_ACTION_INDEX],
+		.subactionPath = handPaths[0],
+		// seriously MS, you can't support this either?!?!
+		//.poseInActionSpace.orientation.w = 1.f,
+		.poseInActionSpace = {
+				.orientation = {
+						.w = 1.f } },
+	};
+
+	result = xrCreateActionSpace(session, &actionSpaceInfo, &handSpaces[0]);
+	if (!xr_result(result, "failed to create left hand pose space")) {
+		return false;
+	}
+
+	actionSpaceInfo.subactionPath = handPaths[1];
+	result = xrCreateActionSpace(session, &actionSpaceInfo, &handSpaces[1]);
+	if (!xr_result(result, "failed to create right hand pose space")) {
+		return false;
+	}
+
+	XrSessionActionSetsAttachInfo attachInfo = {
+		.type = XR_TYPE_SESSION_ACTION_SETS_ATTACH_INFO,
+		.next = NULL,
+		.countActionSets = 1,
+		.actionSets = &actionSet
+	};
+	result = xrAttachSessionActionSets(session, &attachInfo);
+	if (!xr_result(result, "failed to attach action set")) {
+		return false;
+	}
+
+	// our masks can only change after this through XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR
+	if (visibility_mask.is_supported()) {
+		for (uint32_t i = 0; i < view_count; i++) {
+			result = visibility_mask.fetch(session, i);
+			xr_result(result, "Failed to get visibility mask for view {0}", i);
+		}
+	}
+
+	// note, we begin our session once the runtime tells us it's ready, see process_openxr()
+	return true;
+}
+
+void OpenXRApi::destroy_session() {
+	// make sure our frame thread is no longer using our session
+	stop_frame_thread();
+
+	// Destroying our session also destroys our swapchains and spaces, we just forget about them.
+	if (session != XR_NULL_HANDLE) {
+		xrDestroySession(session);
+		session = XR_NULL_HANDLE;
+	}
+	play_space = XR_NULL_HANDLE;
+	view_space = XR_NULL_HANDLE;
+	for (int i = 0; i < HANDCOUNT; i++) {
+		handSpaces[i] = XR_NULL_HANDLE;
+	}
+
+	free_layer_textures();
+	free_release_fences();
+	free_framebuffers();
+	free_depth_swapchains();
+	composition_layers.free_swapchains();
+	projection_submitted = false;
+	free(sample_counts);
+	sample_counts = NULL;
+	free(swapchain_sample_counts);
+	swapchain_sample_counts = NULL;
+	copy_engine.cleanup();
+
+	free(swapchains);
+	swapchains = NULL;
+	if (images) {
+		for (uint32_t i = 0; i < swapchain_count; i++) {
+			free(images[i]);
+		}
+	}
+	free(images);
+	images = NULL;
+	free(image_counts);
+	image_counts = NULL;
+	free(image_acquired);
+	image_acquired = NULL;
+	free(image_waited);
+	image_waited = NULL;
+	swapchain_count = 0;
+
+	frameState = {};
+	frame_in_progress = false;
+	running = false;
+	state = XR_SESSION_STATE_UNKNOWN;
+	tracking.display_time = 0;
+	late_latched_frame_id = 0;
+	last_display_time = 0;
+	frame_work_start_usec = 0;
+}
+
+void OpenXRApi::destroy_instance() {
+	destroy_session();
+
+	free(projection_views);
+	projection_views = NULL;
+	free(depth_infos);
+	depth_infos = NULL;
+	free(configuration_views);
+	configuration_views = NULL;
+	free(buffer_index);
+	buffer_index = NULL;
+	free(projectionLayer);
+	projectionLayer = NULL;
+	free(tracking.views);
+	tracking = {};
+	free(late_latch_views);
+	late_latch_views = NULL;
+
+	// destroying our instance also destroys our action set and actions
+	if (instance != XR_NULL_HANDLE) {
+		xrDestroyInstance(instance);
+		instance = XR_NULL_HANDLE;
+	}
+	actionSet = XR_NULL_HANDLE;
+	for (int i = 0; i < LAST_ACTION_INDEX; i++) {
+		actions[i] = XR_NULL_HANDLE;
+	}
+#ifdef WIN32
+	xrConvertTimeToWin32PerformanceCounterKHR_ptr = NULL;
+#else
+	xrConvertTimeToTimespecTimeKHR_ptr = NULL;
+#endif
+	visibility_mask.clear();
+
+	view_count = 0;
+}
+
+void OpenXRApi::uninitialize() {
+	// make sure our frame thread is no longer using our session
+	stop_frame_thread();
+
+	// and make sure Godot renders our viewport again, at full speed
+	set_render_skipped(false);
+	set_idle_throttle(false);
+
+	if (godot_controllers[0] != 0) {
+		arvr_api->godot_arvr_remove_controller(godot_controllers[0]);
+		godot_controllers[0] = 0;
+	}
+	if (godot_controllers[1] != 0) {
+		arvr_api->godot_arvr_remove_controller(godot_controllers[1]);
+		godot_controllers[1] = 0;
+	}
+
+	destroy_instance();
+
+	// our stream buffers outlive our sessions but not our GL context
+	composition_layers.free_streams();
+
+	event_queue.clear();
+	idle_backoff_usec = 0;
+	idle_next_poll_usec = 0;
+	session_lost = false;
+	instance_lost = false;
+	recovery_retry_usec = 0;
+	recovery_next_attempt_usec = 0;
+	first_frame_pending_usec = 0;
+	successful_init = false;
+}
+
+bool OpenXRApi::is_successful_init() {
+	return successful_init;
+}
+
+uint64_t OpenXRApi::get_time_usec() {
+	// we use the same clocks OpenXR can convert its time to, see xr_time_to_usec()
+#ifdef WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+bool OpenXRApi::xr_time_to_usec(XrTime p_time, uint64_t *r_usec) {
+#ifdef WIN32
+	if (xrConvertTimeToWin32PerformanceCounterKHR_ptr == NULL) {
+		return false;
+	}
+
+	LARGE_INTEGER counter, frequency;
+	XrResult result = xrConvertTimeToWin32PerformanceCounterKHR_ptr(instance, p_time, &counter);
+	if (XR_FAILED(result)) {
+		return false;
+	}
+	QueryPerformanceFrequency(&frequency);
+	*r_usec = (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	if (xrConvertTimeToTimespecTimeKHR_ptr == NULL) {
+		return false;
+	}
+
+	struct timespec ts;
+	XrResult result = xrConvertTimeToTimespecTimeKHR_ptr(instance, p_time, &ts);
+	if (XR_FAILED(result)) {
+		return false;
+	}
+	*r_usec = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+
+	return true;
+}
+
+void OpenXRApi::reset_deadline_stats() {
+	deadline_stats = {};
+}
+
+bool OpenXRApi::update_deadline_stats(uint64_t p_submit_usec) {
+	deadline_stats.frames_submitted++;
+
+	// how much time did we have left until our frame is displayed?
+	uint64_t display_usec;
+	if (!xr_time_to_usec(frameState.predictedDisplayTime, &display_usec)) {
+		deadline_stats.margin_supported = false;
+		return false;
+	}
+	deadline_stats.margin_supported = true;
+
+	int64_t margin = (int64_t)display_usec - (int64_t)p_submit_usec;
+	if (margin < 0) {
+		deadline_stats.frames_late++;
+	}
+
+	if (deadline_stats.margin_count == 0 || margin < deadline_stats.min_margin_usec) {
+		deadline_stats.min_margin_usec = margin;
+	}
+	deadline_stats.margin_count++;
+	deadline_stats.last_margin_usec = margin;
+	deadline_stats.total_margin_usec += margin;
+
+	return margin < 0;
+}
+
+void OpenXRApi::set_max_render_scale(float p_scale) {
+	if (successful_init && p_scale != dynamic_resolution.get_max_scale()) {
+		Godot::print("OpenXR maximum render scale will be applied when OpenXR is initialised again");
+	}
+	dynamic_resolution.set_max_scale(p_scale);
+}
+
+void OpenXRApi::update_render_size() {
+	if (configuration_views == NULL) {
+		return;
+	}
+
+	// can't go beyond what our swapchains were allocated at
+	float scale = dynamic_resolution.get_scale();
+	render_width = (uint32_t)(configuration_views[0].recommendedImageRectWidth * scale + 0.5);
+	render_height = (uint32_t)(configuration_views[0].recommendedImageRectHeight * scale + 0.5);
+	if (render_width > swapchain_width) {
+		render_width = swapchain_width;
+	}
+	if (render_height > swapchain_height) {
+		render_height = swapchain_height;
+	}
+}
+
+void OpenXRApi::set_use_frame_thread(bool p_enable) {
+	if (successful_init && p_enable != use_frame_thread) {
+		Godot::print("OpenXR frame thread setting will be applied when OpenXR is initialised again");
+	}
+	use_frame_thread = p_enable;
+}
+
+void OpenXRApi::reset_frame_timing() {
+	wait_frame_timing.reset();
+	process_timing.reset();
+	frames_missed = 0;
+}
+
+void OpenXRApi::set_idle_max_sleep_msec(int p_msec) {
+	idle_max_sleep_usec = p_msec > 0 ? p_msec * 1000 : 0;
+
+	// applied right away if we're already idle
+	if (idle_throttled) {
+		set_idle_throttle(false);
+		set_idle_throttle(idle_max_sleep_usec > 0);
+	}
+}
+
+bool OpenXRApi::begin_session() {
+	if (running) {
+		// already running
+		return true;
+	}
+
+	XrSessionBeginInfo sessionBeginInfo = {
+		.type = XR_TYPE_SESSION_BEGIN_INFO,
+		.next = NULL,
+		.primaryViewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO
+	};
+	XrResult result = xrBeginSession(session, &sessionBeginInfo);
+	if (!xr_result(result, "Failed to begin session!")) {
+		return false;
+	}
+
+	Godot::print("OpenXR session begun");
+	running = true;
+	set_idle_throttle(false);
+
+	// when recovering we measure from when we lost our session, else from our session becoming ready
+	if (first_frame_pending_usec == 0) {
+		first_frame_pending_usec = get_time_usec();
+	}
+
+	if (use_frame_thread) {
+		start_frame_thread();
+	}
+
+	return true;
+}
+
+void OpenXRApi::end_session() {
+	if (!running) {
+		// not running
+		return;
+	}
+
+	stop_frame_thread();
+
+	if (frame_in_progress) {
+		end_frame(0, NULL);
+	}
+
+	XrResult result = xrEndSession(session);
+	xr_result(result, "Failed to end session!");
+
+	Godot::print("OpenXR session ended");
+	running = false;
+}
+
+void OpenXRApi::on_state_changed(XrSessionState p_state) {
+	state = p_state;
+
+	switch (state) {
+		case XR_SESSION_STATE_READY: {
+			begin_session();
+		} break;
+		case XR_SESSION_STATE_STOPPING: {
+			end_session();
+		} break;
+		case XR_SESSION_STATE_EXITING: {
+			// The runtime wants us to stop our XR experience for good, we don't restart it ourselves.
+			Godot::print("OpenXR session is exiting");
+			destroy_session();
+		} break;
+		case XR_SESSION_STATE_LOSS_PENDING: {
+			on_lost(false);
+		} break;
+		default: {
+			// IDLE, SYNCHRONIZED, VISIBLE and FOCUSED are handled by our frame loop
+		} break;
+	}
+}
+
+void OpenXRApi::on_lost(bool p_instance) {
+	Godot::print("OpenXR lost our {0}, we'll recreate it", p_instance ? "instance" : "session");
+
+	if (p_instance) {
+		destroy_instance();
+		instance_lost = true;
+	} else {
+		destroy_session();
+	}
+	session_lost = true;
+
+	lost_usec = get_time_usec();
+	first_frame_pending_usec = lost_usec;
+	recovery_retry_usec = 0;
+	recovery_next_attempt_usec = 0;
+}
+
+bool OpenXRApi::get_system() {
+	// TODO: Support AR?
+	XrSystemGetInfo systemGetInfo = {
+		.type = XR_TYPE_SYSTEM_GET_INFO,
+		.next = NULL,
+		.formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY,
+	};
+
+	XrResult result = xrGetSystem(instance, &systemGetInfo, &systemId);
+	if (result == XR_ERROR_FORM_FACTOR_UNAVAILABLE) {
+		// our headset isn't connected (yet), not worth an error while we're recovering and polling for it
+		systemId = XR_NULL_SYSTEM_ID;
+		return false;
+	} else if (!xr_result(result, "Failed to get system for HMD form factor.")) {
+		systemId = XR_NULL_SYSTEM_ID;
+		return false;
+	}
+
+	XrSystemProperties systemProperties = {
+		.type = XR_TYPE_SYSTEM_PROPERTIES,
+		.next = NULL,
+		.graphicsProperties = { 0 },
+		.trackingProperties = { 0 },
+	};
+	result = xrGetSystemProperties(instance, systemId, &systemProperties);
+	if (!xr_result(result, "Failed to get System properties")) {
+		return false;
+	}
+
+	// one of these is our projection layer
+	composition_layers.set_max_layers(systemProperties.graphicsProperties.maxLayerCount > 0 ? systemProperties.graphicsProperties.maxLayerCount - 1 : 0);
+
+	// the spec wants this called for our system before we create a session with it
+	return check_graphics_requirements_gl(systemId);
+}
+
+void OpenXRApi::recover() {
+	uint64_t start = get_time_usec();
+	if (start < recovery_next_attempt_usec) {
+		return;
+	}
+
+	bool success;
+	if (instance_lost) {
+		success = create_instance() && create_session();
+	} else {
+		// A lost session may mean our headset was unplugged, our old system id is then no longer valid.
+		// We keep our instance, action sets and paths and only ask for our system again.
+		success = get_system() && create_session();
+	}
+
+	if (!success) {
+		// Our runtime or headset probably isn't back yet, clean up what we did create and try again a little later.
+		// We don't back off too far so we're rendering again soon after it returns.
+		if (instance_lost) {
+			destroy_instance();
+		} else {
+			destroy_session();
+		}
+
+		recovery_stats.failed_attempts++;
+		recovery_retry_usec = recovery_retry_usec == 0 ? 10000 : recovery_retry_usec * 2;
+		if (recovery_retry_usec > 250000) {
+			recovery_retry_usec = 250000;
+		}
+		recovery_next_attempt_usec = get_time_usec() + recovery_retry_usec;
+		return;
+	}
+
+	recovery_stats.last_recreate_usec = get_time_usec() - start;
+	if (instance_lost) {
+		recovery_stats.instances_recovered++;
+	} else {
+		recovery_stats.sessions_recovered++;
+	}
+
+	Godot::print("OpenXR recreated our {0} in {1} ms, {2} ms after losing it",
+			instance_lost ? "instance" : "session",
+			(int64_t)(recovery_stats.last_recreate_usec / 1000),
+			(int64_t)((get_time_usec() - lost_usec) / 1000));
+
+	session_lost = false;
+	instance_lost = false;
+	recovery_retry_usec = 0;
+	recovery_next_attempt_usec = 0;
+
+	// our new session starts out idle, we begin it when it becomes ready
+}
+
+void OpenXRApi::set_swapchain_layout(SwapchainLayout p_layout) {
+	if (successful_init && p_layout != swapchain_layout_setting) {
+		Godot::print("OpenXR swapchain layout will be applied when OpenXR is initialised again");
+	}
+	swapchain_layout_setting = p_layout;
+}
+
+void OpenXRApi::set_swapchain_formats(const SwapchainFormatPolicy::Format *p_formats, int p_count) {
+	if (successful_init) {
+		Godot::print("OpenXR swapchain formats will be applied when OpenXR is initialised again");
+	}
+	if (p_count == 0) {
+		format_policy.clear_preferences();
+	} else {
+		format_policy.set_preferences(p_formats, p_count);
+	}
+}
+
+void OpenXRApi::set_msaa_mode(MSAAMode p_mode) {
+	if (successful_init && p_mode != msaa_mode_setting) {
+		Godot::print("OpenXR MSAA mode will be applied when OpenXR is initialised again");
+	}
+	msaa_mode_setting = p_mode;
+}
+
+void OpenXRApi::set_sample_counts(const std::vector<uint32_t> &p_counts) {
+	if (successful_init) {
+		Godot::print("OpenXR sample counts will be applied when OpenXR is initialised again");
+	}
+	sample_count_setting = p_counts;
+}
+
+void OpenXRApi::setup_sample_counts() {
+	msaa_mode = msaa_mode_setting;
+
+	// Each view gets its configured count, or its last configured count if there are more views than settings
+	uint32_t max_samples = 1;
+	sample_counts = (uint32_t *)malloc(sizeof(uint32_t) * view_count);
+	for (uint32_t i = 0; i < view_count; i++) {
+		uint32_t samples = configuration_views[i].recommendedSwapchainSampleCount;
+		if (!sample_count_setting.empty()) {
+			samples = sample_count_setting[i < sample_count_setting.size() ? i : sample_count_setting.size() - 1];
+		}
+		if (samples > configuration_views[i].maxSwapchainSampleCount) {
+			Godot::print("OpenXR view {0} supports at most {1} samples", i, configuration_views[i].maxSwapchainSampleCount);
+			samples = configuration_views[i].maxSwapchainSampleCount;
+		}
+		if (samples < 1) {
+			samples = 1;
+		}
+		sample_counts[i] = samples;
+		if (samples > max_samples) {
+			max_samples = samples;
+		}
+	}
+
+	// Swapchains shared by our views need one count for all of them, we use the lowest so we stay within every cap
+	swapchain_sample_counts = (uint32_t *)malloc(sizeof(uint32_t) * swapchain_count);
+	for (uint32_t s = 0; s < swapchain_count; s++) {
+		uint32_t samples = sample_counts[s];
+		if (swapchain_count < view_count) {
+			for (uint32_t i = 1; i < view_count; i++) {
+				samples = sample_counts[i] < samples ? sample_counts[i] : samples;
+			}
+		}
+		swapchain_sample_counts[s] = msaa_mode == MSAA_MODE_NATIVE ? samples : 1;
+	}
+
+	// Godot renders all views with the same MSAA setting, so it gets our highest count. In native mode Godot still
+	// renders multisampled and resolves, 3.2 can't render into a multisampled texture nor hand us its own.
+	godot_msaa_samples = sample_count_setting.empty() ? 0 : max_samples;
+
+	Godot::print("OpenXR MSAA {0}, {1} samples for our first view, {2} samples per swapchain image",
+			msaa_mode == MSAA_MODE_NATIVE ? "native" : "resolve", sample_counts[0], swapchain_sample_counts[0]);
+	copy_engine.reset_timing();
+}
+
+void OpenXRApi::set_use_depth(bool p_enable) {
+	if (successful_init && p_enable != use_depth_setting) {
+		Godot::print("OpenXR depth setting will be applied when OpenXR is initialised again");
+	}
+	use_depth_setting = p_enable;
+}
+
+void OpenXRApi::set_use_pipelining(bool p_enable) {
+	if (successful_init && p_enable != use_pipelining) {
+		Godot::print("OpenXR pipelining setting will be applied when OpenXR is initialised again");
+	}
+	use_pipelining = p_enable;
+}
+
+void OpenXRApi::start_frame_thread() {
+	if (frame_thread_active) {
+		// already running
+		return;
+	}
+
+	for (int i = 0; i < FRAME_SLOT_COUNT; i++) {
+		FrameSlot &slot = frame_slots[i];
+
+		slot.frame_state = {};
+		slot.frame_state.type = XR_TYPE_FRAME_STATE;
+		slot.frame_state.next = NULL;
+		slot.tracking_located = false;
+		slot.view_pose_valid = false;
+		slot.head_valid = false;
+
+		slot.views = (XrView *)malloc(sizeof(XrView) * view_count);
+		for (uint32_t v = 0; v < view_count; v++) {
+			slot.views[v].type = XR_TYPE_VIEW;
+			slot.views[v].next = NULL;
+		}
+	}
+	frame_thread_slot = 0;
+	frame_thread_front = 0;
+	frame_thread_back = 1;
+	frames_ended = 0;
+	frames_begun_on_main = 0;
+	frame_thread_begin_failures = 0;
+	frame_in_progress = false;
+
+	// only applied when the thread starts so it can't change while frames are in flight
+	frame_thread_pipelined = use_pipelining;
+
+	Godot::print("OpenXR starting frame thread{0}", frame_thread_pipelined ? " (pipelined)" : "");
+
+	frame_thread_active = true;
+	frame_thread = std::thread(&OpenXRApi::frame_thread_func, this);
+}
+
+void OpenXRApi::stop_frame_thread() {
+	if (!frame_thread_active) {
+		// not running
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(frame_sync_mutex);
+		frame_thread_active = false;
+	}
+	frame_sync_condition.notify_one();
+
+	if (frame_thread.joinable()) {
+		frame_thread.join();
+	}
+
+	for (int i = 0; i < FRAME_SLOT_COUNT; i++) {
+		free(frame_slots[i].views);
+		frame_slots[i].views = NULL;
+	}
+
+	Godot::print("OpenXR stopped frame thread");
+}
+
+void OpenXRApi::frame_thread_func() {
+	uint64_t frames_begun = 0;
+	uint64_t frames_published = 0;
+
+	while (frame_thread_active) {
+		FrameSlot *slot = &frame_slots[frame_thread_back];
+		slot->frame_state.type = XR_TYPE_FRAME_STATE;
+		slot->frame_state.next = NULL;
+		slot->tracking_located = false;
+
+		XrFrameWaitInfo frameWaitInfo = {
+			.type = XR_TYPE_FRAME_WAIT_INFO,
+			.next = NULL
 		};
-		XrPath *paths[] = { aimPosePath, triggerPath, squarePath, menuPath };
-		int num_actions = sizeof(actions) / sizeof(actions[0]);
-		if (!suggestActions("/interaction_profiles/mndx/ball_on_a_stick_controller", actions, paths, num_actions)) {
-			return;
+
+		uint64_t wait_start = get_time_usec();
+		XrResult result = xrWaitFrame(session, &frameWaitInfo, &slot->frame_state);
+		wait_frame_timing.record(get_time_usec() - wait_start);
+		if (!xr_result(result, "xrWaitFrame() was not successful on our frame thread")) {
+			// don't hammer the runtime
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
 		}
-	}
 
-	XrActionSpaceCreateInfo actionSpaceInfo = {
-		.type = XR_TYPE_ACTION_SPACE_CREATE_INFO,
-		.next = NULL,
-		.action = actions[POSE_ACTION_INDEX],
-		.subactionPath = handPaths[0],
-		// seriously MS, you can't support this either?!?!
-		//.poseInActionSpace.orientation.w = 1.f,
-		.poseInActionSpace = {
-				.orientation = {
-						.w = 1.f } },
-	};
+		if (frame_thread_pipelined) {
+			// Locate our views and head for this frame while the main thread is still busy with the previous one,
+			// the main thread begins the frame when it picks it up. These are a frame older than they would be
+			// otherwise, our views are located again right before rendering and the difference ends up in our late latch stats.
+			XrTime display_time = slot->frame_state.predictedDisplayTime;
+			slot->view_pose_valid = locate_views(display_time, slot->views);
+			slot->head_valid = locate_head(display_time, &slot->head);
+			slot->tracking_located = true;
+		} else {
+			// we can't begin a new frame until the main thread has ended the previous one
+			{
+				std::unique_lock<std::mutex> lock(frame_sync_mutex);
+				frame_sync_condition.wait(lock, [&] { return !frame_thread_active || frames_ended == frames_begun; });
+			}
+			if (!frame_thread_active) {
+				break;
+			}
 
-	result = xrCreateActionSpace(session, &actionSpaceInfo, &handSpaces[0]);
-	if (!xr_result(result, "failed to create left hand pose space")) {
-		return;
+			XrFrameBeginInfo frameBeginInfo = {
+				.type = XR_TYPE_FRAME_BEGIN_INFO,
+				.next = NULL
+			};
+			result = xrBeginFrame(session, &frameBeginInfo);
+			if (!xr_result(result, "failed to begin frame on our frame thread!")) {
+				// Nothing is published for this frame, the main thread counts the failure and skips rendering.
+				// Back off like we do for xrWaitFrame, poll_events() stops us if our session is gone.
+				frame_thread_begin_failures++;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			frames_begun++;
+		}
+
+		// publish our new state and take whatever slot was published before as our next back buffer
+		frame_thread_back = frame_thread_slot.exchange(frame_thread_back | FRAME_SLOT_NEW) & ~FRAME_SLOT_NEW;
+		frames_published++;
+
+		if (frame_thread_pipelined) {
+			// we can't wait for another frame until the main thread has begun this one
+			std::unique_lock<std::mutex> lock(frame_sync_mutex);
+			frame_sync_condition.wait(lock, [&] { return !frame_thread_active || frames_begun_on_main == frames_published; });
+		}
 	}
+}
 
-	actionSpaceInfo.subactionPath = handPaths[1];
-	result = xrCreateActionSpace(session, &actionSpaceInfo, &handSpaces[1]);
-	if (!xr_result(result, "failed to create right hand pose space")) {
-		return;
+OpenXRApi::FrameSlot *OpenXRApi::acquire_frame_from_thread() {
+	if ((frame_thread_slot & FRAME_SLOT_NEW) == 0) {
+		// no new frame has been prepared since we last checked
+		return NULL;
 	}
 
-	XrSessionActionSetsAttachInfo attachInfo = {
-		.type = XR_TYPE_SESSION_ACTION_SETS_ATTACH_INFO,
+	frame_thread_front = frame_thread_slot.exchange(frame_thread_front) & ~FRAME_SLOT_NEW;
+	FrameSlot *slot = &frame_slots[frame_thread_front];
+	frameState = slot->frame_state;
+	return slot;
+}
+
+void OpenXRApi::end_frame(uint32_t layer_count, const XrCompositionLayerBaseHeader *const *layers) {
+	// MS wants these in order..
+	XrFrameEndInfo frameEndInfo = {
+		.type = XR_TYPE_FRAME_END_INFO,
 		.next = NULL,
-		.countActionSets = 1,
-		.actionSets = &actionSet
+		.displayTime = frameState.predictedDisplayTime,
+		.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE,
+		.layerCount = layer_count,
+		.layers = layers,
 	};
-	result = xrAttachSessionActionSets(session, &attachInfo);
-	if (!xr_result(result, "failed to attach action set")) {
-		return;
-	}
-
-	godot_controllers[0] = arvr_api->godot_arvr_add_controller((char *)"lefthand", 1, true, true);
-	godot_controllers[1] = arvr_api->godot_arvr_add_controller((char *)"righthand", 2, true, true);
+	uint64_t submit_usec = get_time_usec();
+	XrResult result = xrEndFrame(session, &frameEndInfo);
+	frame_timings.record(FrameTimings::PHASE_END_FRAME, get_time_usec());
+	frame_in_progress = false;
 
-	Godot::print("OpenXR initialized controllers {0} {1}", godot_controllers[0], godot_controllers[1]);
+	bool late = update_deadline_stats(submit_usec);
 
-	// We've made it!
-	successful_init = true;
-}
+	if (layer_count > 0 && first_frame_pending_usec != 0) {
+		uint64_t first_frame_usec = submit_usec - first_frame_pending_usec;
+		first_frame_pending_usec = 0;
 
-OpenXRApi::~OpenXRApi() {
-	free(projection_views);
-	free(configuration_views);
-	free(buffer_index);
-	free(swapchains);
-	if (images) {
-		for (uint32_t i = 0; i < view_count; i++) {
-			free(images[i]);
+		recovery_stats.first_frames++;
+		recovery_stats.last_first_frame_usec = first_frame_usec;
+		if (first_frame_usec > recovery_stats.max_first_frame_usec) {
+			recovery_stats.max_first_frame_usec = first_frame_usec;
 		}
+		Godot::print("OpenXR first frame submitted after {0} ms", (int64_t)(first_frame_usec / 1000));
 	}
-	free(images);
-	free(projectionLayer);
-	free(views);
 
-	if (session) {
-		xrDestroySession(session);
+	// only frames we actually rendered tell us something about what our resolution costs
+	if (layer_count > 0 && frame_work_start_usec != 0) {
+		dynamic_resolution.update(submit_usec - frame_work_start_usec, (uint64_t)(frameState.predictedDisplayPeriod / 1000), late);
 	}
-	xrDestroyInstance(instance);
-}
 
-bool OpenXRApi::is_successful_init() {
-	return successful_init;
+	if (frame_thread_active && !frame_thread_pipelined) {
+		// let our frame thread know it can begin the next frame
+		{
+			std::lock_guard<std::mutex> lock(frame_sync_mutex);
+			frames_ended++;
+		}
+		frame_sync_condition.notify_one();
+	}
+
+	xr_result(result, "failed to end frame!");
+
+	// our frame is on its way, now we have time for our events
+	process_events();
 }
 
 XrAction OpenXRApi::createAction(XrActionType actionType, const char *actionName, const char *localizedActionName) {
@@ -948,26 +1791,468 @@ bool OpenXRApi::check_graphics_requirements_gl(XrSystemId system_id) {
 	return true;
 }
 
-XrResult OpenXRApi::acquire_image(int eye) {
+Viewport *OpenXRApi::get_arvr_viewport() {
+	Engine *engine = Engine::get_singleton();
+	if (engine == NULL) {
+		return NULL;
+	}
+
+	SceneTree *tree = Object::cast_to<SceneTree>(engine->get_main_loop());
+	if (tree == NULL) {
+		return NULL;
+	}
+
+	// TODO support ARVR viewports that aren't our root viewport
+	Viewport *viewport = tree->get_root();
+	if (viewport == NULL || !viewport->use_arvr()) {
+		return NULL;
+	}
+
+	return viewport;
+}
+
+bool OpenXRApi::set_render_skipped(bool p_skip) {
+	if (p_skip == render_skipped) {
+		// nothing changes
+		return true;
+	}
+
+	Viewport *viewport = get_arvr_viewport();
+	if (viewport == NULL) {
+		// can't find our viewport, render_openxr() will discard our frames instead
+		render_skipped = false;
+		return false;
+	}
+
+	if (p_skip) {
+		skipped_viewport_update_mode = viewport->get_update_mode();
+		viewport->set_update_mode(Viewport::UPDATE_DISABLED);
+	} else {
+		viewport->set_update_mode(skipped_viewport_update_mode);
+	}
+	render_skipped = p_skip;
+
+	return true;
+}
+
+XrResult OpenXRApi::acquire_image(int eye, bool p_block) {
 	XrResult result;
+	uint32_t sc = get_swapchain_for_eye(eye);
+
 	XrSwapchainImageAcquireInfo swapchainImageAcquireInfo = {
 		.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, .next = NULL
 	};
-	result = xrAcquireSwapchainImage(swapchains[eye], &swapchainImageAcquireInfo, &buffer_index[eye]);
-	if (!xr_result(result, "failed to acquire swapchain image!")) {
-		return result;
+	if (!image_acquired[sc]) {
+		result = xrAcquireSwapchainImage(swapchains[sc], &swapchainImageAcquireInfo, &buffer_index[sc]);
+		if (!xr_result(result, "failed to acquire swapchain image!")) {
+			return result;
+		}
+		image_acquired[sc] = true;
+		image_waited[sc] = false;
+	}
+
+	// acquired separately from our colour image so a failure here doesn't leave us thinking we have both
+	if (depth_swapchains != NULL && !depth_acquired[sc]) {
+		result = xrAcquireSwapchainImage(depth_swapchains[sc], &swapchainImageAcquireInfo, &depth_buffer_index[sc]);
+		if (!xr_result(result, "failed to acquire depth swapchain image!")) {
+			return result;
+		}
+		depth_acquired[sc] = true;
+		depth_waited[sc] = false;
+	}
+
+	bool need_depth = depth_swapchains != NULL && !depth_waited[sc];
+	if (image_waited[sc] && !need_depth) {
+		// shared with another eye, or acquired ahead of time, and ready to use
+		return XR_SUCCESS;
 	}
 
+	// XR_TIMEOUT_EXPIRED is a success code, our images stay acquired and we wait for whichever we haven't waited for later,
+	// waiting twice for the same image is a call order error
 	XrSwapchainImageWaitInfo swapchainImageWaitInfo = {
 		.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
 		.next = NULL,
-		.timeout = 0
+		.timeout = swapchain_wait_timeout
 	};
-	result = xrWaitSwapchainImage(swapchains[eye], &swapchainImageWaitInfo);
-	if (!xr_result(result, "failed to wait for swapchain image!")) {
-		return result;
+	uint64_t wait_start = get_time_usec();
+	if (!image_waited[sc]) {
+		do {
+			result = xrWaitSwapchainImage(swapchains[sc], &swapchainImageWaitInfo);
+			if (result == XR_TIMEOUT_EXPIRED) {
+				swapchain_wait_stats.timeouts++;
+			}
+		} while (result == XR_TIMEOUT_EXPIRED && p_block);
+
+		if (!xr_result(result, "failed to wait for swapchain image!")) {
+			record_image_wait(get_time_usec() - wait_start);
+			return result;
+		}
+		image_waited[sc] = result == XR_SUCCESS;
 	}
-	return XR_SUCCESS;
+
+	if (image_waited[sc] && need_depth) {
+		do {
+			result = xrWaitSwapchainImage(depth_swapchains[sc], &swapchainImageWaitInfo);
+			if (result == XR_TIMEOUT_EXPIRED) {
+				swapchain_wait_stats.timeouts++;
+			}
+		} while (result == XR_TIMEOUT_EXPIRED && p_block);
+
+		if (!xr_result(result, "failed to wait for depth swapchain image!")) {
+			record_image_wait(get_time_usec() - wait_start);
+			return result;
+		}
+		depth_waited[sc] = result == XR_SUCCESS;
+	}
+	record_image_wait(get_time_usec() - wait_start);
+
+	return image_waited[sc] && (depth_swapchains == NULL || depth_waited[sc]) ? XR_SUCCESS : XR_TIMEOUT_EXPIRED;
+}
+
+void OpenXRApi::acquire_images() {
+	// Acquire and wait for all our images right after beginning our frame, so Godot gets ready images without blocking
+	// and we see any back pressure from the runtime before Godot starts rendering.
+	check_release_fences();
+
+	for (uint32_t eye = 0; eye < view_count; eye++) {
+		XrResult result = acquire_image(eye, false);
+		if (!xr_result(result, "failed to acquire swapchain image!")) {
+			return;
+		}
+	}
+
+	frame_timings.record(FrameTimings::PHASE_IMAGES_ACQUIRED, get_time_usec());
+}
+
+void OpenXRApi::record_image_wait(uint64_t p_usec) {
+	swapchain_wait_stats.waits++;
+	swapchain_wait_stats.last_wait_usec = p_usec;
+	if (p_usec > swapchain_wait_stats.max_wait_usec) {
+		swapchain_wait_stats.max_wait_usec = p_usec;
+	}
+
+	// if our own GPU work from last frame was still running the runtime may well have been waiting on us
+	if (gpu_busy_at_acquire) {
+		swapchain_wait_stats.gpu_busy_wait_usec += p_usec;
+	} else {
+		swapchain_wait_stats.runtime_wait_usec += p_usec;
+	}
+}
+
+void OpenXRApi::check_release_fences() {
+	gpu_busy_at_acquire = false;
+	if (release_fences == NULL) {
+		return;
+	}
+
+	for (uint32_t sc = 0; sc < swapchain_count; sc++) {
+		if (release_fences[sc] == 0) {
+			continue;
+		}
+
+		// don't wait, we only want to know if our GPU finished what we submitted with our previous frame
+		GLenum status = glClientWaitSync(release_fences[sc], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			gpu_busy_at_acquire = true;
+		}
+		glDeleteSync(release_fences[sc]);
+		release_fences[sc] = 0;
+	}
+
+	if (gpu_busy_at_acquire) {
+		swapchain_wait_stats.gpu_busy_frames++;
+	}
+}
+
+void OpenXRApi::free_release_fences() {
+	if (release_fences == NULL) {
+		return;
+	}
+
+	for (uint32_t sc = 0; sc < swapchain_count; sc++) {
+		if (release_fences[sc] != 0) {
+			glDeleteSync(release_fences[sc]);
+		}
+	}
+	free(release_fences);
+	release_fences = NULL;
+}
+
+void OpenXRApi::set_swapchain_wait_timeout_usec(uint64_t p_usec) {
+	swapchain_wait_timeout = (XrDuration)p_usec * 1000;
+}
+
+XrResult OpenXRApi::release_image(int eye) {
+	uint32_t sc = get_swapchain_for_eye(eye);
+	if (!image_acquired[sc]) {
+		// nothing to release
+		return XR_SUCCESS;
+	}
+
+	if (swapchain_count < view_count && eye != (int)view_count - 1) {
+		// shared with the eyes that follow, we release it after our last eye
+		return XR_SUCCESS;
+	}
+
+	XrSwapchainImageReleaseInfo swapchainImageReleaseInfo = {
+		.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO,
+		.next = NULL
+	};
+	if (depth_swapchains != NULL && depth_acquired[sc] && depth_waited[sc]) {
+		// a depth image we never finished waiting for stays acquired, we wait for it again next frame
+		depth_acquired[sc] = false;
+		depth_waited[sc] = false;
+		XrResult result = xrReleaseSwapchainImage(depth_swapchains[sc], &swapchainImageReleaseInfo);
+		xr_result(result, "failed to release depth swapchain image!");
+	}
+
+	if (release_fences != NULL) {
+		// marks the end of everything we rendered or copied into this image, see check_release_fences()
+		if (release_fences[sc] != 0) {
+			glDeleteSync(release_fences[sc]);
+		}
+		release_fences[sc] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	image_acquired[sc] = false;
+	image_waited[sc] = false;
+	return xrReleaseSwapchainImage(swapchains[sc], &swapchainImageReleaseInfo);
+}
+
+bool OpenXRApi::create_depth_swapchains(const int64_t *p_formats, uint32_t p_format_count, uint32_t p_array_size, uint32_t p_image_width) {
+	XrResult result;
+
+	// Depth blits need matching formats, Godot renders with a 24 bit depth buffer so we prefer that
+	const int64_t preferred_formats[] = { GL_DEPTH_COMPONENT24, GL_DEPTH24_STENCIL8, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT16 };
+	depth_format = 0;
+	for (uint32_t p = 0; p < sizeof(preferred_formats) / sizeof(preferred_formats[0]) && depth_format == 0; p++) {
+		for (uint32_t i = 0; i < p_format_count; i++) {
+			if (p_formats[i] == preferred_formats[p]) {
+				depth_format = preferred_formats[p];
+				break;
+			}
+		}
+	}
+	if (depth_format == 0) {
+		Godot::print("OpenXR runtime has no depth swapchain format we can use, not submitting depth");
+		return true;
+	}
+
+	depth_swapchains = (XrSwapchain *)malloc(sizeof(XrSwapchain) * swapchain_count);
+	depth_images = (XrSwapchainImageOpenGLKHR **)malloc(sizeof(XrSwapchainImageOpenGLKHR *) * swapchain_count);
+	depth_image_counts = (uint32_t *)malloc(sizeof(uint32_t) * swapchain_count);
+	depth_buffer_index = (uint32_t *)malloc(sizeof(uint32_t) * swapchain_count);
+	depth_acquired = (bool *)malloc(sizeof(bool) * swapchain_count);
+	depth_waited = (bool *)malloc(sizeof(bool) * swapchain_count);
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		depth_swapchains[i] = XR_NULL_HANDLE;
+		depth_images[i] = NULL;
+		depth_image_counts[i] = 0;
+		depth_buffer_index[i] = 0;
+		depth_acquired[i] = false;
+		depth_waited[i] = false;
+	}
+
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		XrSwapchainCreateInfo swapchainCreateInfo = {
+			.type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+			.next = NULL,
+			.createFlags = 0,
+			.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			.format = depth_format,
+			.sampleCount = swapchain_sample_counts[i],
+			.width = p_image_width,
+			.height = swapchain_height,
+			.faceCount = 1,
+			.arraySize = p_array_size,
+			.mipCount = 1,
+		};
+
+		result = xrCreateSwapchain(session, &swapchainCreateInfo, &depth_swapchains[i]);
+		if (!xr_result(result, "Failed to create depth swapchain {0}!", i)) {
+			return false;
+		}
+
+		result = xrEnumerateSwapchainImages(depth_swapchains[i], 0, &depth_image_counts[i], NULL);
+		if (!xr_result(result, "Failed to enumerate depth swapchains")) {
+			return false;
+		}
+
+		depth_images[i] = (XrSwapchainImageOpenGLKHR *)malloc(sizeof(XrSwapchainImageOpenGLKHR) * depth_image_counts[i]);
+		for (uint32_t j = 0; j < depth_image_counts[i]; j++) {
+			depth_images[i][j].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR;
+			depth_images[i][j].next = NULL;
+		}
+
+		result = xrEnumerateSwapchainImages(depth_swapchains[i], depth_image_counts[i], &depth_image_counts[i], (XrSwapchainImageBaseHeader *)depth_images[i]);
+		if (!xr_result(result, "Failed to enumerate depth swapchain images")) {
+			return false;
+		}
+	}
+
+	Godot::print("OpenXR submitting depth, format {0}", depth_format);
+	return true;
+}
+
+void OpenXRApi::free_depth_swapchains() {
+	// destroyed together with our session
+	if (depth_images != NULL) {
+		for (uint32_t i = 0; i < swapchain_count; i++) {
+			free(depth_images[i]);
+		}
+	}
+	free(depth_images);
+	depth_images = NULL;
+	free(depth_swapchains);
+	depth_swapchains = NULL;
+	free(depth_image_counts);
+	depth_image_counts = NULL;
+	free(depth_buffer_index);
+	depth_buffer_index = NULL;
+	free(depth_acquired);
+	depth_acquired = NULL;
+	free(depth_waited);
+	depth_waited = NULL;
+	depth_format = 0;
+}
+
+void OpenXRApi::copy_depth_to_swapchain(int eye, uint32_t texid) {
+	// Godot 3.2 gives us no way to hand it a depth texture to render into so we blit its depth buffer over,
+	// we only chain our depth info into views we managed to copy depth for
+	projection_views[eye].next = NULL;
+
+	uint32_t sc = get_swapchain_for_eye(eye);
+	if (!depth_waited[sc]) {
+		return;
+	}
+
+	// Godot renders into its own texture or, with external texture support, straight into our image
+	GLuint image = layer_textures != NULL ? layer_textures[buffer_index[sc] * view_count + eye] : images[sc][buffer_index[sc]].image;
+	GLuint source = CopyEngine::find_depth_source(texid, image);
+	if (source == 0) {
+		return;
+	}
+
+	CopyEngine::Target target;
+	target.texture = depth_images[sc][depth_buffer_index[sc]].image;
+	target.layer = swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY ? eye : -1;
+	target.x = projection_views[eye].subImage.imageRect.offset.x;
+	target.framebuffer = depth_framebuffers[sc][depth_buffer_index[sc] * framebuffer_layers + (target.layer >= 0 ? target.layer : 0)];
+	target.multisample = is_multisampled(sc);
+	target.cube_map = false;
+
+	if (copy_engine.copy_depth(source, target, render_width, render_height)) {
+		depth_infos[eye].subImage.imageRect.extent.width = render_width;
+		depth_infos[eye].subImage.imageRect.extent.height = render_height;
+		projection_views[eye].next = &depth_infos[eye];
+	}
+}
+
+void OpenXRApi::create_layer_textures() {
+	// Godot 3.2 can only render into a GL_TEXTURE_2D so we need a 2D view of each layer of our array images.
+	// Views need GL 4.3 or ARB_texture_view and immutable textures, without them we copy into our layers.
+	layer_textures = NULL;
+
+#ifndef WIN32
+	if (!CopyEngine::has_extension("GL_ARB_texture_view")) {
+		Godot::print("OpenXR GL_ARB_texture_view not supported, copying into our swapchain layers");
+		return;
+	}
+
+	for (uint32_t i = 0; i < image_counts[0]; i++) {
+		GLint immutable = 0;
+		glBindTexture(GL_TEXTURE_2D_ARRAY, images[0][i].image);
+		glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		if (!immutable) {
+			Godot::print("OpenXR swapchain images aren't immutable, copying into our swapchain layers");
+			return;
+		}
+	}
+
+	layer_textures = (GLuint *)malloc(sizeof(GLuint) * image_counts[0] * view_count);
+	glGenTextures(image_counts[0] * view_count, layer_textures);
+	for (uint32_t i = 0; i < image_counts[0]; i++) {
+		for (uint32_t v = 0; v < view_count; v++) {
+			glTextureView(layer_textures[i * view_count + v], GL_TEXTURE_2D, images[0][i].image, swapchain_format, 0, 1, v, 1);
+		}
+	}
+#else
+	// glad only gives us GL 3.3
+	Godot::print("OpenXR copying into our swapchain layers");
+#endif
+}
+
+void OpenXRApi::free_layer_textures() {
+	if (layer_textures != NULL) {
+		glDeleteTextures(image_counts[0] * view_count, layer_textures);
+		free(layer_textures);
+		layer_textures = NULL;
+	}
+}
+
+void OpenXRApi::copy_to_swapchain(int eye, uint32_t texid) {
+	// copy Godots render target into our image, our layer or our half of the image
+	uint32_t sc = get_swapchain_for_eye(eye);
+	CopyEngine::Target target;
+	target.texture = images[sc][buffer_index[sc]].image;
+	target.layer = swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY ? eye : -1;
+	target.x = projection_views[eye].subImage.imageRect.offset.x;
+	target.framebuffer = framebuffers[sc][buffer_index[sc] * framebuffer_layers + (target.layer >= 0 ? target.layer : 0)];
+	target.multisample = is_multisampled(sc);
+	target.cube_map = false;
+
+	copy_engine.copy(texid, target, render_width, render_height);
+}
+
+GLuint **OpenXRApi::create_framebuffer_cache(GLenum p_attachment, XrSwapchainImageOpenGLKHR **p_images, const uint32_t *p_image_counts) {
+	GLuint **cache = (GLuint **)malloc(sizeof(GLuint *) * swapchain_count);
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		cache[i] = (GLuint *)malloc(sizeof(GLuint) * p_image_counts[i] * framebuffer_layers);
+		for (uint32_t j = 0; j < p_image_counts[i]; j++) {
+			for (uint32_t l = 0; l < framebuffer_layers; l++) {
+				GLint layer = swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY ? (GLint)l : -1;
+				cache[i][j * framebuffer_layers + l] = CopyEngine::create_framebuffer(p_attachment, p_images[i][j].image, layer, is_multisampled(i), false);
+			}
+		}
+	}
+
+	return cache;
+}
+
+void OpenXRApi::free_framebuffer_cache(GLuint **p_cache, const uint32_t *p_image_counts) {
+	if (p_cache == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < swapchain_count; i++) {
+		// deleting 0 is silently ignored
+		glDeleteFramebuffers(p_image_counts[i] * framebuffer_layers, p_cache[i]);
+		free(p_cache[i]);
+	}
+	free(p_cache);
+}
+
+void OpenXRApi::create_framebuffers() {
+	// Building these up front means our driver validates each attachment once instead of on every copy
+	framebuffer_layers = swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY ? view_count : 1;
+	framebuffers = create_framebuffer_cache(GL_COLOR_ATTACHMENT0, images, image_counts);
+	if (depth_swapchains != NULL) {
+		depth_framebuffers = create_framebuffer_cache(GL_DEPTH_ATTACHMENT, depth_images, depth_image_counts);
+	}
+}
+
+void OpenXRApi::free_framebuffers() {
+	free_framebuffer_cache(framebuffers, image_counts);
+	framebuffers = NULL;
+	free_framebuffer_cache(depth_framebuffers, depth_image_counts);
+	depth_framebuffers = NULL;
+}
+
+void OpenXRApi::benchmark_copy(uint32_t p_width, uint32_t p_height, int p_iterations, uint64_t *r_usec) {
+	// measure at our swapchain format if we have one, Godots render target is copied into that
+	GLenum format = swapchain_format != 0 ? (GLenum)swapchain_format : GL_SRGB8_ALPHA8;
+	copy_engine.benchmark(p_width, p_height, format, p_iterations, r_usec);
 }
 
 void OpenXRApi::render_openxr(int eye, uint32_t texid, bool has_external_texture_support) {
@@ -979,126 +2264,111 @@ void OpenXRApi::render_openxr(int eye, uint32_t texid, bool has_external_texture
 	if (!running || state >= XR_SESSION_STATE_STOPPING)
 		return;
 
+	// no frame was begun for this render, i.e. our frame thread didn't have a new frame ready for us
+	if (!frame_in_progress)
+		return;
+
+	frame_timings.record(eye == 0 ? FrameTimings::PHASE_COMMIT_LEFT : FrameTimings::PHASE_COMMIT_RIGHT, get_time_usec());
+
 	// must have valid view pose for projection_views[eye].pose to submit layer
-	if (!frameState.shouldRender || !view_pose_valid) {
+	if (!frameState.shouldRender || !tracking.view_pose_valid) {
 		/* Godot 3.1: we acquire and release the image below in this function.
 		 * Godot 3.2+: get_external_texture_for_eye() on acquires the image,
 		 * therefore we have to release it here.
-		 * TODO: Tell godot not to call get_external_texture_for_eye() when
-		 * frameState.shouldRender is false, then remove the image release here
+		 * Note that when frameState.shouldRender is false we normally stop Godot
+		 * from rendering our viewport in process_openxr(), we only get here if we
+		 * couldn't find it or if we don't have a valid view pose.
 		 */
-		if (has_external_texture_support) {
-			XrSwapchainImageReleaseInfo swapchainImageReleaseInfo = {
-				.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO,
-				.next = NULL
-			};
-			result = xrReleaseSwapchainImage(swapchains[eye], &swapchainImageReleaseInfo);
-			if (!xr_result(result, "failed to release swapchain image!")) {
-				return;
-			}
+		result = release_image(eye);
+		if (!xr_result(result, "failed to release swapchain image!")) {
+			return;
 		}
 
 		if (eye == 1) {
-			// MS wants these in order..
 			// submit 0 layers when we shouldn't render
-			XrFrameEndInfo frameEndInfo = {
-				.type = XR_TYPE_FRAME_END_INFO,
-				.next = NULL,
-				.displayTime = frameState.predictedDisplayTime,
-				.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE,
-				.layerCount = 0,
-				.layers = NULL,
-			};
-			result = xrEndFrame(session, &frameEndInfo);
-			xr_result(result, "failed to end frame!");
+			end_frame(0, NULL);
 		}
 
 		// neither eye is rendered
 		return;
 	}
 
+	// everything we do on our GPU to get this eye into our swapchain, i.e. our copy or MSAA replication
+	copy_engine.begin_timing();
+
 	if (!has_external_texture_support) {
-		result = acquire_image(eye);
+		result = acquire_image(eye, true);
 		if (!xr_result(result, "failed to acquire swapchain image!")) {
+			copy_engine.end_timing();
 			return;
 		}
 
-		glBindTexture(GL_TEXTURE_2D, texid);
-#ifdef WIN32
-		glCopyTexSubImage2D(
-#else
-		glCopyTextureSubImage2D(
-#endif
-				images[eye][buffer_index[eye]].image, 0, 0, 0,
-				0, 0,
-				configuration_views[eye].recommendedImageRectWidth,
-				configuration_views[eye].recommendedImageRectHeight);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		// printf("Copy godot texture %d into XR texture %d\n", texid,
-		// images[eye][bufferIndex].image);
+		copy_to_swapchain(eye, texid);
 	} else {
 		// printf("Godot already rendered into our textures\n");
 	}
 
-	XrSwapchainImageReleaseInfo swapchainImageReleaseInfo = {
-		.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO,
-		.next = NULL
-	};
-	result = xrReleaseSwapchainImage(swapchains[eye], &swapchainImageReleaseInfo);
+	if (depth_swapchains != NULL) {
+		copy_depth_to_swapchain(eye, texid);
+	}
+
+	copy_engine.end_timing();
+
+	result = release_image(eye);
 	if (!xr_result(result, "failed to release swapchain image!")) {
 		return;
 	}
 
-	projection_views[eye].fov = views[eye].fov;
-	projection_views[eye].pose = views[eye].pose;
+	projection_views[eye].fov = tracking.views[eye].fov;
+	projection_views[eye].pose = tracking.views[eye].pose;
+	projection_views[eye].subImage.imageRect.extent.width = render_width;
+	projection_views[eye].subImage.imageRect.extent.height = render_height;
 
 	if (eye == 1) {
 		projectionLayer->views = projection_views;
-
-		const XrCompositionLayerBaseHeader *const projectionlayers[1] = { (const XrCompositionLayerBaseHeader *const)
-					projectionLayer };
-		XrFrameEndInfo frameEndInfo = {
-			.type = XR_TYPE_FRAME_END_INFO,
-			.next = NULL,
-			.displayTime = frameState.predictedDisplayTime,
-			.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE,
-			.layerCount = 1,
-			.layers = projectionlayers,
-		};
-		result = xrEndFrame(session, &frameEndInfo);
-		if (!xr_result(result, "failed to end frame!")) {
-			return;
+		if (projection_views[0].next != NULL || projection_views[1].next != NULL) {
+			depth_frames++;
 		}
+
+		submit_frame();
+		projection_submitted = true;
 	}
 }
 
+void OpenXRApi::submit_frame() {
+	// our other layers are only copied into their swapchains when their content changed,
+	// the compositor reprojects whatever they last had every display period
+	composition_layers.update(session);
+	composition_layers.get_submit_layers(play_space, layers_behind, layers_in_front);
+
+	// whatever is behind us shows through where Godot left our viewport transparent
+	projectionLayer->layerFlags = !layers_behind.empty() && projection_blend ? XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT : 0;
+	// fades are applied by the compositor, we don't render anything for them
+	projectionLayer->next = composition_layers.get_projection_next();
+
+	frame_layers.clear();
+	frame_layers.insert(frame_layers.end(), layers_behind.begin(), layers_behind.end());
+	frame_layers.push_back((const XrCompositionLayerBaseHeader *)projectionLayer);
+	frame_layers.insert(frame_layers.end(), layers_in_front.begin(), layers_in_front.end());
+	end_frame((uint32_t)frame_layers.size(), frame_layers.data());
+}
+
 void OpenXRApi::fill_projection_matrix(int eye, godot_real p_z_near, godot_real p_z_far, godot_real *p_projection) {
 	XrMatrix4x4f matrix;
 
-	// TODO duplicate xrLocateViews call in fill_projection_matrix and process_openxr
-	// fill_projection_matrix is called first, so we definitely need it here.
-	XrViewLocateInfo viewLocateInfo = {
-		.type = XR_TYPE_VIEW_LOCATE_INFO,
-		.next = NULL,
-		.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO,
-		.displayTime = frameState.predictedDisplayTime,
-		.space = play_space
-	};
-	XrViewState viewState = {
-		.type = XR_TYPE_VIEW_STATE,
-		.next = NULL
-	};
-	uint32_t viewCountOutput;
-	XrResult result;
-	result = xrLocateViews(session, &viewLocateInfo, &viewState, view_count, &viewCountOutput, views);
-	if (!xr_result(result, "Could not locate views")) {
-		return;
-	}
-	if (!xr_result(result, "Could not locate views")) {
+	// our views are located in process_openxr(), nothing to do until that has happened
+	if (tracking.display_time == 0) {
 		return;
 	}
 
-	XrMatrix4x4f_CreateProjectionFov(&matrix, GRAPHICS_OPENGL, views[eye].fov, p_z_near, p_z_far);
+	// Godot calls this right before rendering each eye, our last chance to get fresher poses
+	late_latch_tracking();
+
+	XrMatrix4x4f_CreateProjectionFov(&matrix, GRAPHICS_OPENGL, tracking.views[eye].fov, p_z_near, p_z_far);
+
+	// the runtime needs the same planes to make sense of the depth we submit
+	depth_infos[eye].nearZ = p_z_near;
+	depth_infos[eye].farZ = p_z_far;
 
 	// printf("Projection Matrix: ");
 	for (int i = 0; i < 16; i++) {
@@ -1124,14 +2394,9 @@ bool OpenXRApi::transform_from_pose(godot_transform *p_dest, XrPosef *pose, floa
 	return true;
 };
 
-void OpenXRApi::update_controllers() {
+void OpenXRApi::sync_actions() {
 	XrResult result;
 
-	// xrWaitFrame not run yet
-	if (frameState.predictedDisplayTime == 0) {
-		return;
-	}
-
 	const XrActiveActionSet activeActionSet = {
 		.actionSet = actionSet,
 		.subactionPath = XR_NULL_PATH
@@ -1144,6 +2409,143 @@ void OpenXRApi::update_controllers() {
 	};
 	result = xrSyncActions(session, &syncInfo);
 	xr_result(result, "failed to sync actions!");
+}
+
+bool OpenXRApi::locate_views(XrTime p_time, XrView *r_views) {
+	// can be called from our frame thread
+	XrViewLocateInfo viewLocateInfo = {
+		.type = XR_TYPE_VIEW_LOCATE_INFO,
+		.next = NULL,
+		.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO,
+		.displayTime = p_time,
+		.space = play_space
+	};
+	XrViewState viewState = {
+		.type = XR_TYPE_VIEW_STATE,
+		.next = NULL
+	};
+	uint32_t viewCountOutput;
+	XrResult result = xrLocateViews(session, &viewLocateInfo, &viewState, view_count, &viewCountOutput, r_views);
+	if (!xr_result(result, "Could not locate views")) {
+		return false;
+	}
+
+	return (viewState.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) != 0 &&
+		   (viewState.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) != 0;
+}
+
+bool OpenXRApi::locate_head(XrTime p_time, XrSpaceLocation *r_location) {
+	// can be called from our frame thread
+	r_location->type = XR_TYPE_SPACE_LOCATION;
+	r_location->next = NULL;
+
+	XrResult result = xrLocateSpace(view_space, play_space, p_time, r_location);
+	if (!xr_result(result, "Failed to locate view space in play space!")) {
+		return false;
+	}
+
+	return (r_location->locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0 &&
+		   (r_location->locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0;
+}
+
+void OpenXRApi::locate_tracking(const FrameSlot *p_slot) {
+	XrResult result;
+
+	// One pass per frame, everything is located at the same display time.
+	// Note that sync_actions() must have been called first or our hand spaces won't be current.
+	tracking.frame_id++;
+	tracking.display_time = frameState.predictedDisplayTime;
+
+	if (p_slot != NULL && p_slot->tracking_located) {
+		// our frame thread already located our views and head for this frame
+		memcpy(tracking.views, p_slot->views, sizeof(XrView) * view_count);
+		tracking.view_pose_valid = p_slot->view_pose_valid;
+		tracking.views_located_early = true;
+		tracking.head = p_slot->head;
+		tracking.head_valid = p_slot->head_valid;
+	} else {
+		tracking.view_pose_valid = locate_views(tracking.display_time, tracking.views);
+		tracking.views_located_early = false;
+		tracking.head_valid = locate_head(tracking.display_time, &tracking.head);
+	}
+
+	for (int i = 0; i < HANDCOUNT; i++) {
+		tracking.hands[i].type = XR_TYPE_SPACE_LOCATION;
+		tracking.hands[i].next = NULL;
+
+		result = xrLocateSpace(handSpaces[i], play_space, tracking.display_time, &tracking.hands[i]);
+		if (!xr_result(result, "failed to locate space {0}!", i)) {
+			tracking.hand_valid[i] = false;
+		} else {
+			tracking.hand_valid[i] =
+					//(tracking.hands[i].locationFlags &
+					// XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0 &&
+					(tracking.hands[i].locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0;
+		}
+	}
+}
+
+void OpenXRApi::late_latch_tracking() {
+	// only once per frame and only if we have something to improve on,
+	// views our frame thread located while the previous frame rendered are always worth locating again
+	if ((!late_latch && !tracking.views_located_early) || tracking.display_time == 0 || late_latched_frame_id == tracking.frame_id) {
+		return;
+	}
+	late_latched_frame_id = tracking.frame_id;
+
+	// we can't locate anything once our frame has been submitted
+	if (!frame_in_progress || !tracking.view_pose_valid) {
+		return;
+	}
+
+	if (!locate_views(tracking.display_time, late_latch_views)) {
+		// keep what we have
+		return;
+	}
+
+	// record how far our prediction moved, we use the largest change of all views
+	float position_delta = 0.0;
+	float rotation_delta = 0.0;
+	for (uint32_t i = 0; i < view_count; i++) {
+		const XrPosef &early = tracking.views[i].pose;
+		const XrPosef &late = late_latch_views[i].pose;
+
+		float dx = late.position.x - early.position.x;
+		float dy = late.position.y - early.position.y;
+		float dz = late.position.z - early.position.z;
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		if (distance > position_delta) {
+			position_delta = distance;
+		}
+
+		float dot = fabsf(early.orientation.x * late.orientation.x + early.orientation.y * late.orientation.y + early.orientation.z * late.orientation.z + early.orientation.w * late.orientation.w);
+		float angle = 2.0 * acosf(dot > 1.0 ? 1.0 : dot) * 180.0 / MATH_PI;
+		if (angle > rotation_delta) {
+			rotation_delta = angle;
+		}
+
+		tracking.views[i].pose = late;
+		tracking.views[i].fov = late_latch_views[i].fov;
+	}
+
+	late_latch_stats.count++;
+	late_latch_stats.last_position = position_delta;
+	late_latch_stats.total_position += position_delta;
+	if (position_delta > late_latch_stats.max_position) {
+		late_latch_stats.max_position = position_delta;
+	}
+	late_latch_stats.last_rotation = rotation_delta;
+	late_latch_stats.total_rotation += rotation_delta;
+	if (rotation_delta > late_latch_stats.max_rotation) {
+		late_latch_stats.max_rotation = rotation_delta;
+	}
+}
+
+void OpenXRApi::update_controllers() {
+	// xrWaitFrame not run yet
+	if (tracking.display_time == 0) {
+		return;
+	}
 
 	XrActionStateFloat triggerStates[HANDCOUNT];
 	getActionStates(actions[TRIGGER_ACTION_INDEX], XR_TYPE_ACTION_STATE_FLOAT, (void **)triggerStates);
@@ -1163,8 +2565,6 @@ void OpenXRApi::update_controllers() {
 	XrActionStateFloat thumbstickYAxisStates[HANDCOUNT];
 	getActionStates(actions[THUMBSTICK_Y_AXIS_ACTION_INDEX], XR_TYPE_ACTION_STATE_FLOAT, (void **)thumbstickYAxisStates);
 
-	XrSpaceLocation spaceLocation[HANDCOUNT];
-
 	for (int i = 0; i < HANDCOUNT; i++) {
 		if (!poseStates[i].isActive) {
 			// printf("Pose for hand %d is not active %d\n", i,
@@ -1172,22 +2572,12 @@ void OpenXRApi::update_controllers() {
 			continue;
 		}
 
-		spaceLocation[i].type = XR_TYPE_SPACE_LOCATION;
-		spaceLocation[i].next = NULL;
-
-		result = xrLocateSpace(handSpaces[i], play_space, frameState.predictedDisplayTime, &spaceLocation[i]);
-		xr_result(result, "failed to locate space {0}!", i);
-		bool spaceLocationValid =
-				//(spaceLocation[i].locationFlags &
-				// XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0 &&
-				(spaceLocation[i].locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0;
-
 		godot_transform controller_transform;
-		if (!spaceLocationValid) {
+		if (!tracking.hand_valid[i]) {
 			Godot::print_error(String("OpenXR Space location not valid for hand") + String::num_int64(i), __FUNCTION__, __FILE__, __LINE__);
 			continue;
 		} else {
-			if (!transform_from_pose(&controller_transform, &spaceLocation[i].pose, 1.0)) {
+			if (!transform_from_pose(&controller_transform, &tracking.hands[i].pose, 1.0)) {
 				Godot::print("OpenXR Pose for hand {0} is active but invalid\n", i);
 				continue;
 			}
@@ -1195,8 +2585,8 @@ void OpenXRApi::update_controllers() {
 
 #if 0
 		printf("pose for controller %d - %f %f %f - %f %f %f %f\n", i,
-			spaceLocation[i].pose.position.x, spaceLocation[i].pose.position.y, spaceLocation[i].pose.position.z,
-			spaceLocation[i].pose.orientation.x, spaceLocation[i].pose.orientation.y, spaceLocation[i].pose.orientation.z, spaceLocation[i].pose.orientation.w
+			tracking.hands[i].pose.position.x, tracking.hands[i].pose.position.y, tracking.hands[i].pose.position.z,
+			tracking.hands[i].pose.orientation.x, tracking.hands[i].pose.orientation.y, tracking.hands[i].pose.orientation.z, tracking.hands[i].pose.orientation.w
 		);
 #endif
 
@@ -1255,8 +2645,8 @@ void OpenXRApi::update_controllers() {
 }
 
 void OpenXRApi::recommended_rendertarget_size(uint32_t *width, uint32_t *height) {
-	*width = configuration_views[0].recommendedImageRectWidth;
-	*height = configuration_views[0].recommendedImageRectHeight;
+	*width = render_width;
+	*height = render_height;
 }
 
 void OpenXRApi::transform_from_matrix(godot_transform *p_dest, XrMatrix4x4f *matrix, float p_world_scale) {
@@ -1289,43 +2679,35 @@ void OpenXRApi::transform_from_matrix(godot_transform *p_dest, XrMatrix4x4f *mat
 
 bool OpenXRApi::get_view_transform(int eye, float world_scale, godot_transform *transform_for_eye) {
 	// xrWaitFrame not run yet
-	if (frameState.predictedDisplayTime == 0) {
+	if (tracking.display_time == 0) {
 		return false;
 	}
 
-	if (views == NULL || !view_pose_valid) {
+	// normally already done in fill_projection_matrix()
+	late_latch_tracking();
+
+	if (tracking.views == NULL || !tracking.view_pose_valid) {
 		Godot::print_error("OpenxR don't have valid view pose! (check tracking?)", __FUNCTION__, __FILE__, __LINE__);
 		return false;
 	}
 
-	transform_from_pose(transform_for_eye, &views[eye].pose, world_scale);
+	transform_from_pose(transform_for_eye, &tracking.views[eye].pose, world_scale);
 
 	return true;
 }
 
 bool OpenXRApi::get_head_center(float world_scale, godot_transform *transform) {
 	// xrWaitFrame not run yet
-	if (frameState.predictedDisplayTime == 0) {
-		return false;
-	}
-
-	XrResult result;
-	XrSpaceLocation location = {
-		.type = XR_TYPE_SPACE_LOCATION,
-		.next = NULL
-	};
-	result = xrLocateSpace(view_space, play_space, frameState.predictedDisplayTime, &location);
-	if (!xr_result(result, "Failed to locate view space in play space!")) {
+	if (tracking.display_time == 0) {
 		return false;
 	}
 
-	if ((location.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) == 0 ||
-			(location.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) == 0) {
+	if (!tracking.head_valid) {
 		Godot::print_error("OpenXR View space location not valid (check tracking?)", __FUNCTION__, __FILE__, __LINE__);
 		return false;
 	}
 
-	transform_from_pose(transform, &location.pose, world_scale);
+	transform_from_pose(transform, &tracking.head.pose, world_scale);
 
 	return true;
 }
@@ -1334,7 +2716,20 @@ int OpenXRApi::get_external_texture_for_eye(int eye, bool *has_support) {
 	// this only gets called from Godot 3.2 and newer, allows us to use
 	// OpenXR swapchain directly.
 
-	XrResult result = acquire_image(eye);
+	// we can only acquire images for a frame that has been begun
+	if (!frame_in_progress) {
+		return 0;
+	}
+
+	if ((swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY && layer_textures == NULL) || swapchain_layout == SWAPCHAIN_LAYOUT_SIDE_BY_SIDE || is_multisampled(get_swapchain_for_eye(eye))) {
+		// Godot can't render into a layer of our array images, nor into half of a texture, nor into a multisampled one,
+		// let it render into its own texture and copy it
+		*has_support = false;
+		return 0;
+	}
+
+	// normally acquired ahead of time in process_openxr(), this only blocks if the runtime didn't have it ready then
+	XrResult result = acquire_image(eye, true);
 	if (!xr_result(result, "failed to acquire swapchain image!")) {
 		return 0;
 	}
@@ -1345,155 +2740,408 @@ int OpenXRApi::get_external_texture_for_eye(int eye, bool *has_support) {
 		// texture chain
 		*has_support = true;
 		// printf("eye %d: get texture %d\n", eye, buffer_index[eye]);
-		return images[eye][buffer_index[eye]].image;
+		uint32_t sc = get_swapchain_for_eye(eye);
+		if (swapchain_layout == SWAPCHAIN_LAYOUT_ARRAY) {
+			return layer_textures[buffer_index[sc] * view_count + eye];
+		}
+		return images[sc][buffer_index[sc]].image;
 	}
 
 	return 0;
 }
 
-void OpenXRApi::process_openxr() {
-	XrResult result;
-
+bool OpenXRApi::poll_events() {
+	// Only handle what affects our frame loop right away, everything else is queued and handled by
+	// process_events() after we've submitted our frame. We always drain the runtimes queue, it is bounded
+	// and overflows into EVENTS_LOST, and a state change stuck behind other events would be handled late.
+	// Our event_budget limits what process_events() handles per frame instead.
 	XrEventDataBuffer runtimeEvent = {
 		.type = XR_TYPE_EVENT_DATA_BUFFER,
 		.next = NULL
 	};
 
-	XrResult pollResult = xrPollEvent(instance, &runtimeEvent);
-	while (pollResult == XR_SUCCESS) {
+	uint64_t now = get_time_usec();
+	while (true) {
+		runtimeEvent.type = XR_TYPE_EVENT_DATA_BUFFER;
+		XrResult pollResult = xrPollEvent(instance, &runtimeEvent);
+		if (pollResult == XR_EVENT_UNAVAILABLE) {
+			// processed all events in the queue
+			break;
+		} else if (pollResult != XR_SUCCESS) {
+			Godot::print_error("OpenXR Failed to poll events!", __FUNCTION__, __FILE__, __LINE__);
+			return false;
+		}
+
+		// something is happening, make sure we poll again on Godots next tick
+		idle_backoff_usec = 0;
+		idle_next_poll_usec = 0;
+
 		switch (runtimeEvent.type) {
 			case XR_TYPE_EVENT_DATA_EVENTS_LOST: {
 				XrEventDataEventsLost *event = (XrEventDataEventsLost *)&runtimeEvent;
-
-				Godot::print("OpenXR EVENT: {0} event data lost!", event->lostEventCount);
-				// we probably didn't poll fast enough'
+				event_queue.push(EventQueue::EVENT_EVENTS_LOST, event->lostEventCount, 0, now);
 			} break;
 			case XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR: {
 				XrEventDataVisibilityMaskChangedKHR *event = (XrEventDataVisibilityMaskChangedKHR *)&runtimeEvent;
-				Godot::print("OpenXR EVENT: STUB: visibility mask changed");
+				event_queue.push(EventQueue::EVENT_VISIBILITY_MASK_CHANGED, event->viewIndex, 0, now);
 			} break;
 			case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
 				XrEventDataInstanceLossPending *event = (XrEventDataInstanceLossPending *)&runtimeEvent;
-				Godot::print("OpenXR EVENT: instance loss pending at {0}!", event->lossTime);
-				running = false;
-				return;
+				event_queue.push(EventQueue::EVENT_INSTANCE_LOSS_PENDING, 0, event->lossTime, now);
+				on_lost(true);
+
+				// our instance is gone, nothing more to poll
+				return true;
 			} break;
 			case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
 				XrEventDataSessionStateChanged *event = (XrEventDataSessionStateChanged *)&runtimeEvent;
-				// XrSessionState state = event->state;
-
-				state = event->state;
-				Godot::print("OpenXR EVENT: session state changed to {0}", state);
-				if (event->state >= XR_SESSION_STATE_STOPPING) {
-					Godot::print_error("Abort Mission!", __FUNCTION__, __FILE__, __LINE__);
-					running = false;
-					return;
+
+				if (event->session != session) {
+					// left over from a session we've already destroyed
+					break;
 				}
+				event_queue.push(EventQueue::EVENT_SESSION_STATE_CHANGED, event->state, event->time, now);
+				on_state_changed(event->state);
 			} break;
 			case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING: {
 				XrEventDataReferenceSpaceChangePending *event = (XrEventDataReferenceSpaceChangePending *)&runtimeEvent;
-				Godot::print("OpenXR EVENT: reference space type {0} change pending!", event->referenceSpaceType);
+				event_queue.push(EventQueue::EVENT_REFERENCE_SPACE_CHANGE_PENDING, event->referenceSpaceType, event->changeTime, now);
 				// TODO: do something
 			} break;
 			case XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED: {
+				// we look up our new profiles once our frame is submitted
+				event_queue.push(EventQueue::EVENT_INTERACTION_PROFILE_CHANGED, 0, 0, now);
+			} break;
+			default:
+				event_queue.push(EventQueue::EVENT_UNKNOWN, runtimeEvent.type, 0, now);
+				break;
+		}
+	}
+
+	return true;
+}
+
+void OpenXRApi::process_events() {
+	// Called once our frame has been submitted (or when we're not rendering), this is where we log our
+	// events, do any slow lookups and let Godot know through our listeners. We handle at most event_budget
+	// events per frame, the rest wait in our queue for our next frame.
+	EventQueue::Event event;
+	int processed = 0;
+	while ((event_budget == 0 || processed < event_budget) && event_queue.pop(&event)) {
+		processed++;
+
+		switch (event.type) {
+			case EventQueue::EVENT_EVENTS_LOST: {
+				// we probably didn't poll fast enough
+				Godot::print("OpenXR EVENT: {0} event data lost!", event.value);
+				emit_event_signal("events_lost", event.value);
+			} break;
+			case EventQueue::EVENT_INSTANCE_LOSS_PENDING: {
+				Godot::print("OpenXR EVENT: instance loss pending at {0}!", event.time);
+				emit_event_signal("instance_loss_pending");
+			} break;
+			case EventQueue::EVENT_SESSION_STATE_CHANGED: {
+				Godot::print("OpenXR EVENT: session state changed to {0}", event.value);
+				emit_event_signal("session_state_changed", event.value);
+			} break;
+			case EventQueue::EVENT_REFERENCE_SPACE_CHANGE_PENDING: {
+				Godot::print("OpenXR EVENT: reference space type {0} change pending!", event.value);
+				emit_event_signal("reference_space_change_pending", event.value);
+			} break;
+			case EventQueue::EVENT_INTERACTION_PROFILE_CHANGED: {
 				Godot::print("OpenXR EVENT: interaction profile changed!");
-				XrEventDataInteractionProfileChanged *event = (XrEventDataInteractionProfileChanged *)&runtimeEvent;
-
-				XrInteractionProfileState state = {
-					.type = XR_TYPE_INTERACTION_PROFILE_STATE
-				};
-
-				XrPath hand_paths[2];
-				xrStringToPath(instance, "/user/hand/left", &hand_paths[0]);
-				xrStringToPath(instance, "/user/hand/right", &hand_paths[1]);
-				for (int i = 0; i < 2; i++) {
-					XrResult res = xrGetCurrentInteractionProfile(session, hand_paths[i], &state);
-					if (!xr_result(res, "Failed to get interaction profile for {0}", i)) {
+				if (session == XR_NULL_HANDLE) {
+					// lost our session since
+					break;
+				}
+
+				for (int i = 0; i < HANDCOUNT; i++) {
+					const char *hand = i == HAND_LEFT ? "/user/hand/left" : "/user/hand/right";
+
+					XrInteractionProfileState state = {
+						.type = XR_TYPE_INTERACTION_PROFILE_STATE,
+						.next = NULL
+					};
+					XrResult res = xrGetCurrentInteractionProfile(session, handPaths[i], &state);
+					if (!xr_result(res, "Failed to get interaction profile for {0}", hand)) {
 						continue;
 					}
 
 					XrPath prof = state.interactionProfile;
 					if (prof == XR_NULL_PATH) {
-						Godot::print("OpenXR No interaction profile for {0}", i == 0 ? "/user/hand/left" : "/user/hand/right");
+						Godot::print("OpenXR No interaction profile for {0}", hand);
+						emit_event_signal("interaction_profile_changed", String(hand), String());
 						continue;
 					}
 
 					uint32_t strl;
 					char profile_str[XR_MAX_PATH_LENGTH];
 					res = xrPathToString(instance, prof, XR_MAX_PATH_LENGTH, &strl, profile_str);
-					if (!xr_result(res, "Failed to get interaction profile path str for {0}", i == 0 ? "/user/hand/left" : "/user/hand/right")) {
+					if (!xr_result(res, "Failed to get interaction profile path str for {0}", hand)) {
 						continue;
 					}
 
-					Godot::print("OpenXR Event: Interaction profile changed for {0}: {1}", i == 0 ? "/user/hand/left" : "/user/hand/right", profile_str);
+					Godot::print("OpenXR Event: Interaction profile changed for {0}: {1}", hand, profile_str);
+					emit_event_signal("interaction_profile_changed", String(hand), String(profile_str));
 				}
-
-				// TODO: do something
 			} break;
-			default:
-				Godot::print_error(String("OpenXR Unhandled event type ") + String::num_int64(runtimeEvent.type), __FUNCTION__, __FILE__, __LINE__);
-				break;
+			case EventQueue::EVENT_VISIBILITY_MASK_CHANGED: {
+				if (visibility_mask.is_supported() && session != XR_NULL_HANDLE) {
+					XrResult result = visibility_mask.fetch(session, (uint32_t)event.value);
+					xr_result(result, "Failed to get visibility mask for view {0}", event.value);
+				}
+				emit_event_signal("visibility_mask_changed", event.value);
+			} break;
+			default: {
+				Godot::print_error(String("OpenXR Unhandled event type ") + String::num_int64(event.value), __FUNCTION__, __FILE__, __LINE__);
+			} break;
 		}
+	}
+}
 
-		runtimeEvent.type = XR_TYPE_EVENT_DATA_BUFFER;
-		pollResult = xrPollEvent(instance, &runtimeEvent);
+void OpenXRApi::register_event_listener(godot::Object *p_listener) {
+	for (size_t i = 0; i < event_listeners.size(); i++) {
+		if (event_listeners[i] == p_listener) {
+			// already registered
+			return;
+		}
+	}
+	event_listeners.push_back(p_listener);
+}
+
+void OpenXRApi::unregister_event_listener(godot::Object *p_listener) {
+	for (size_t i = 0; i < event_listeners.size(); i++) {
+		if (event_listeners[i] == p_listener) {
+			event_listeners.erase(event_listeners.begin() + i);
+			return;
+		}
+	}
+}
+
+void OpenXRApi::idle_backoff() {
+	idle_backoff_usec = idle_backoff_usec == 0 ? 1000 : idle_backoff_usec * 2;
+	if (idle_backoff_usec > idle_max_sleep_usec) {
+		idle_backoff_usec = idle_max_sleep_usec;
+	}
+
+	idle_next_poll_usec = idle_backoff_usec > 0 ? get_time_usec() + idle_backoff_usec : 0;
+	set_idle_throttle(idle_max_sleep_usec > 0);
+}
+
+void OpenXRApi::set_idle_throttle(bool p_throttle) {
+	if (p_throttle == idle_throttled) {
+		return;
+	}
+
+	OS *os = OS::get_singleton();
+	if (os == NULL) {
+		return;
 	}
-	if (pollResult == XR_EVENT_UNAVAILABLE) {
-		// processed all events in the queue
+
+	if (p_throttle) {
+		// Godot sleeps between its own iterations, so the CPU idles without us blocking its main thread
+		saved_low_processor_mode = os->is_in_low_processor_usage_mode();
+		saved_low_processor_sleep_usec = os->get_low_processor_usage_mode_sleep_usec();
+		os->set_low_processor_usage_mode(true);
+		os->set_low_processor_usage_mode_sleep_usec((int64_t)idle_max_sleep_usec);
 	} else {
-		Godot::print_error("OpenXR Failed to poll events!", __FUNCTION__, __FILE__, __LINE__);
+		os->set_low_processor_usage_mode(saved_low_processor_mode);
+		os->set_low_processor_usage_mode_sleep_usec(saved_low_processor_sleep_usec);
+	}
+	idle_throttled = p_throttle;
+}
+
+void OpenXRApi::process_openxr() {
+	XrResult result;
+	uint64_t process_start = get_time_usec();
+
+	if (frame_in_progress) {
+		// Godot didn't render our last frame, we still need to end it
+		end_frame(0, NULL);
+	}
+
+	frame_timings.start_frame(process_start);
+
+	if (session_lost) {
+		recover();
+	}
+
+	if (instance == XR_NULL_HANDLE) {
+		// still waiting for our instance to come back, there is nothing to poll, recover() backs off on its own
+		set_render_skipped(true);
+		set_idle_throttle(idle_max_sleep_usec > 0);
+		process_events();
 		return;
 	}
 
-	XrFrameWaitInfo frameWaitInfo = {
-		.type = XR_TYPE_FRAME_WAIT_INFO,
-		.next = NULL
-	};
-	result = xrWaitFrame(session, &frameWaitInfo, &frameState);
-	if (!xr_result(result, "xrWaitFrame() was not successful, exiting...")) {
+	if (!running && idle_next_poll_usec != 0 && process_start < idle_next_poll_usec) {
+		// backing off while idle, we don't hold up Godot, we just don't poll on every tick
+		process_events();
 		return;
 	}
 
-	update_controllers();
+	if (!poll_events()) {
+		return;
+	}
+	frame_timings.record(FrameTimings::PHASE_EVENTS_POLLED, get_time_usec());
 
-	XrViewLocateInfo viewLocateInfo = {
-		.type = XR_TYPE_VIEW_LOCATE_INFO,
-		.next = NULL,
-		.viewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO,
-		.displayTime = frameState.predictedDisplayTime,
-		.space = play_space
-	};
-	XrViewState viewState = {
-		.type = XR_TYPE_VIEW_STATE,
-		.next = NULL
-	};
-	uint32_t viewCountOutput;
-	result = xrLocateViews(session, &viewLocateInfo, &viewState, view_count, &viewCountOutput, views);
-	if (!xr_result(result, "Could not locate views")) {
+	if (!running) {
+		// Our session isn't running (IDLE, or we've been stopped), there is nothing to render.
+		// Make sure Godot doesn't render our viewport and back off so we don't poll on every tick,
+		// we're back to full speed on the first event we receive.
+		set_render_skipped(true);
+		process_events();
+		idle_backoff();
 		return;
 	}
 
-	bool pose_invalid = false;
-	for (int i = 0; i < viewCountOutput; i++) {
-		if ((viewState.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) == 0 ||
-				(viewState.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) == 0) {
-			pose_invalid = true;
+	FrameSlot *slot = NULL;
+	if (frame_thread_active) {
+		// our frame thread has already waited for our frame, pick it up without blocking
+		deadline_stats.frames_not_begun += frame_thread_begin_failures.exchange(0);
+
+		slot = acquire_frame_from_thread();
+		if (slot == NULL) {
+			// there is no frame for Godot to render into, same as when the runtime tells us not to render
+			frames_missed++;
+			set_render_skipped(true);
+			process_timing.record(get_time_usec() - process_start);
+			return;
+		}
+
+		if (frame_thread_pipelined) {
+			// in pipelined mode we begin the frame, the previous one has been ended by now
+			XrFrameBeginInfo frameBeginInfo = {
+				.type = XR_TYPE_FRAME_BEGIN_INFO,
+				.next = NULL
+			};
+			result = xrBeginFrame(session, &frameBeginInfo);
+
+			// let our frame thread know it can wait for the next frame
+			{
+				std::lock_guard<std::mutex> lock(frame_sync_mutex);
+				frames_begun_on_main++;
+			}
+			frame_sync_condition.notify_one();
+
+			if (!xr_result(result, "failed to begin frame!")) {
+				deadline_stats.frames_not_begun++;
+				set_render_skipped(true);
+				return;
+			}
+			frame_timings.record(FrameTimings::PHASE_BEGIN_FRAME, get_time_usec());
+		}
+		frame_in_progress = true;
+	} else {
+		XrFrameWaitInfo frameWaitInfo = {
+			.type = XR_TYPE_FRAME_WAIT_INFO,
+			.next = NULL
+		};
+		uint64_t wait_start = get_time_usec();
+		result = xrWaitFrame(session, &frameWaitInfo, &frameState);
+		wait_frame_timing.record(get_time_usec() - wait_start);
+		if (!xr_result(result, "xrWaitFrame() was not successful, exiting...")) {
+			return;
+		}
+	}
+	frame_work_start_usec = get_time_usec();
+	frame_timings.record(FrameTimings::PHASE_WAIT_FRAME, frame_work_start_usec);
+
+	// if the runtime skipped display periods since our last frame, we didn't deliver in time
+	if (last_display_time != 0 && frameState.predictedDisplayPeriod > 0 && frameState.predictedDisplayTime > last_display_time) {
+		XrTime periods = (frameState.predictedDisplayTime - last_display_time + frameState.predictedDisplayPeriod / 2) / frameState.predictedDisplayPeriod;
+		if (periods > 1) {
+			deadline_stats.skipped_periods += periods - 1;
 		}
 	}
-	view_pose_valid = !pose_invalid;
+	last_display_time = frameState.predictedDisplayTime;
 
-	XrFrameBeginInfo frameBeginInfo = {
-		.type = XR_TYPE_FRAME_BEGIN_INFO,
-		.next = NULL
-	};
+	if (!frameState.shouldRender) {
+		deadline_stats.frames_not_rendered++;
+	}
 
-	result = xrBeginFrame(session, &frameBeginInfo);
-	if (!xr_result(result, "failed to begin frame!")) {
-		return;
+	// locate everything we track once for this frame, then update our controllers from that
+	sync_actions();
+	locate_tracking(slot);
+	update_controllers();
+	frame_timings.record(FrameTimings::PHASE_CONTROLLERS_UPDATED, get_time_usec());
+
+	if (!frame_thread_active) {
+		XrFrameBeginInfo frameBeginInfo = {
+			.type = XR_TYPE_FRAME_BEGIN_INFO,
+			.next = NULL
+		};
+
+		result = xrBeginFrame(session, &frameBeginInfo);
+		if (!xr_result(result, "failed to begin frame!")) {
+			deadline_stats.frames_not_begun++;
+			set_render_skipped(true);
+			return;
+		}
+		frame_timings.record(FrameTimings::PHASE_BEGIN_FRAME, get_time_usec());
+		frame_in_progress = true;
+	}
+
+	// Godot asks for our render target size after we return, apply any change our dynamic resolution made last frame
+	update_render_size();
+
+	if (godot_msaa_samples != 0) {
+		Viewport *viewport = get_arvr_viewport();
+		if (viewport != NULL) {
+			int64_t msaa = Viewport::MSAA_DISABLED;
+			if (godot_msaa_samples >= 16) {
+				msaa = Viewport::MSAA_16X;
+			} else if (godot_msaa_samples >= 8) {
+				msaa = Viewport::MSAA_8X;
+			} else if (godot_msaa_samples >= 4) {
+				msaa = Viewport::MSAA_4X;
+			} else if (godot_msaa_samples >= 2) {
+				msaa = Viewport::MSAA_2X;
+			}
+			viewport->set_msaa(msaa);
+			godot_msaa_samples = 0;
+		}
+	}
+
+	// Layers behind our projection layer, i.e. a cube map sky, replace Godots background.
+	// A transparent background stops Godot from clearing to or drawing its sky so the runtime can blend us on top.
+	bool blend = composition_layers.has_layers_behind();
+	if (blend != projection_blend) {
+		Viewport *viewport = get_arvr_viewport();
+		if (viewport != NULL) {
+			viewport->set_transparent_background(blend);
+			projection_blend = blend;
+			if (blend && !SwapchainFormatPolicy::has_alpha(swapchain_format)) {
+				Godot::print("OpenXR our swapchain format has no alpha, layers behind our projection layer won't show");
+			}
+		}
+	}
+
+	if (linear_output_pending) {
+		// our swapchain stores linear colour, Godots ARVR viewport may not exist until after we're initialised
+		Viewport *viewport = get_arvr_viewport();
+		if (viewport != NULL) {
+			viewport->set_keep_3d_linear(true);
+			linear_output_pending = false;
+		}
 	}
 
-	if (frameState.shouldRender) {
-		// TODO: Tell godot not do render VR to save resources.
-		// See render_openxr() for the corresponding early exit.
+	if (!frameState.shouldRender && set_render_skipped(true)) {
+		// Godot won't render our viewport so nothing will end our frame, submit it empty right away
+		end_frame(0, NULL);
+	} else if (frameState.shouldRender && hold_frame && projection_submitted && frame_in_progress && set_render_skipped(true)) {
+		// Our swapchains still have the images we last released, the runtime shows those again.
+		// Our other layers keep updating, Godot renders on this thread so its GL context is current here,
+		// i.e. a loading panel or video keeps moving while our scene fades out.
+		held_frames++;
+		frame_work_start_usec = 0; // nothing was rendered, this frame says nothing about our resolution
+		submit_frame();
+	} else if (frameState.shouldRender) {
+		set_render_skipped(false);
+		if (frame_in_progress) {
+			acquire_images();
+		}
 	}
+
+	process_timing.record(get_time_usec() - process_start);
 }
@@ -5,6 +5,7 @@
 #define OPENXR_API_H
 
 #include <Godot.hpp>
+#include <Viewport.hpp>
 
 #ifdef WIN32
 #include <windows.h>
@@ -13,6 +14,19 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CompositionLayers.h"
+#include "CopyEngine.h"
+#include "DynamicResolution.h"
+#include "EventQueue.h"
+#include "FrameTimings.h"
+#include "SwapchainFormatPolicy.h"
+#include "VisibilityMask.h"
 #include "xrmath.h"
 #include <openxr/openxr.h>
 
@@ -22,6 +36,7 @@
 #define XR_USE_PLATFORM_WIN32
 #else
 #define XR_USE_PLATFORM_XLIB
+#define XR_USE_TIMESPEC
 #endif
 #define XR_USE_GRAPHICS_API_OPENGL
 
@@ -31,6 +46,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef WIN32
 #include <glad/glad.h>
@@ -67,14 +83,126 @@ public:
 		LAST_ACTION_INDEX,
 	};
 
+	// Keeps track of how long something takes, can be updated from any thread. All times are in microseconds.
+	struct TimingCounter {
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> total_usec;
+		std::atomic<uint64_t> max_usec;
+		std::atomic<uint64_t> last_usec;
+
+		TimingCounter() :
+				count(0),
+				total_usec(0),
+				max_usec(0),
+				last_usec(0) {}
+
+		void record(uint64_t p_usec) {
+			count++;
+			total_usec += p_usec;
+			last_usec = p_usec;
+			if (p_usec > max_usec) {
+				max_usec = p_usec;
+			}
+		}
+
+		void reset() {
+			count = 0;
+			total_usec = 0;
+			max_usec = 0;
+			last_usec = 0;
+		}
+	};
+
+	// Keeps track of whether we submit our frames in time for the display time the runtime predicted.
+	struct DeadlineStats {
+		uint64_t frames_submitted; // frames for which we called xrEndFrame
+		uint64_t frames_late; // frames we submitted after their predicted display time
+		uint64_t skipped_periods; // display periods where the runtime had no new frame from us
+		uint64_t frames_not_rendered; // frames where frameState.shouldRender was false
+		uint64_t frames_not_begun; // frames we waited for but xrBeginFrame failed on, on either thread
+		bool margin_supported; // we can only measure our margin if we can convert runtime time to our clock
+		uint64_t margin_count;
+		int64_t last_margin_usec; // time between submitting and the predicted display time, negative if late
+		int64_t min_margin_usec;
+		int64_t total_margin_usec;
+	};
+
+	// Keeps track of how much our views moved between locating them at the start of the frame and late latching them.
+	struct PoseDeltaStats {
+		uint64_t count;
+		float last_position; // in meters
+		float max_position;
+		double total_position;
+		float last_rotation; // in degrees
+		float max_rotation;
+		double total_rotation;
+	};
+
+	enum MSAAMode {
+		MSAA_MODE_RESOLVE, // single sample swapchains, Godot resolves its multisampled render target into them
+		MSAA_MODE_NATIVE // multisampled swapchains, the runtime resolves them
+	};
+
+	enum SwapchainLayout {
+		SWAPCHAIN_LAYOUT_PER_VIEW, // one swapchain per view
+		SWAPCHAIN_LAYOUT_ARRAY, // one swapchain with an array layer per view
+		SWAPCHAIN_LAYOUT_SIDE_BY_SIDE, // one swapchain with our views next to each other
+	};
+
+	// How long we wait for our swapchain images, split by whether our own GPU work from our previous frame was still running
+	struct SwapchainWaitStats {
+		uint64_t waits; // times we waited for an image
+		uint64_t timeouts; // waits that hit our timeout
+		uint64_t last_wait_usec;
+		uint64_t max_wait_usec;
+		uint64_t runtime_wait_usec; // total time waited while our GPU was idle, back pressure from the runtime
+		uint64_t gpu_busy_wait_usec; // total time waited while our previous frame was still on our GPU
+		uint64_t gpu_busy_frames; // frames where our previous frame was still on our GPU when we acquired
+	};
+
+	// How quickly we get back to rendering after losing our session or instance, or after our session resumes
+	struct RecoveryStats {
+		uint64_t sessions_recovered;
+		uint64_t instances_recovered;
+		uint64_t failed_attempts;
+		uint64_t last_recreate_usec; // time spent recreating our session (and instance)
+		uint64_t first_frames; // number of times we measured time to first frame
+		uint64_t last_first_frame_usec; // from losing our session, or it becoming ready, until our first frame was submitted
+		uint64_t max_first_frame_usec;
+	};
+
 private:
 	static OpenXRApi *singleton;
 	bool successful_init;
 	int use_count;
 
 	XrInstance instance = XR_NULL_HANDLE;
+	XrSystemId systemId = XR_NULL_SYSTEM_ID;
 	XrSession session = XR_NULL_HANDLE;
 
+	// When our session is lost we recreate just our session, swapchains and spaces, our instance, action set
+	// and paths are kept. When our instance is lost we have no choice but to recreate that as well.
+	bool session_lost = false;
+	bool instance_lost = false;
+	uint64_t lost_usec = 0;
+	uint64_t recovery_retry_usec = 0;
+	uint64_t recovery_next_attempt_usec = 0;
+	uint64_t first_frame_pending_usec = 0; // set while we're waiting to submit our first frame
+	RecoveryStats recovery_stats = {};
+
+	// Events are queued while polling and handled once our frame has been submitted, see poll_events()
+	int event_budget = 16; // max queued events processed per frame, 0 is unlimited, we always poll everything
+	EventQueue event_queue;
+	std::vector<godot::Object *> event_listeners; // objects we emit our event signals on
+
+	template <class... Args>
+	void emit_event_signal(const char *p_signal, Args... p_args) {
+		// deferred so scripts don't run while we're in the middle of our frame
+		for (size_t i = 0; i < event_listeners.size(); i++) {
+			event_listeners[i]->call_deferred("emit_signal", p_signal, p_args...);
+		}
+	}
+
 	/* XR_REFERENCE_SPACE_TYPE_LOCAL: head pose on startup/recenter is coordinate system origin.
 	 * XR_REFERENCE_SPACE_TYPE_STAGE: origin is externally calibrated to be on play space floor. */
 	XrReferenceSpaceType play_space_type = XR_REFERENCE_SPACE_TYPE_STAGE;
@@ -86,35 +214,194 @@ private:
 #else
 	XrGraphicsBindingOpenGLXlibKHR graphics_binding_gl;
 #endif
+	// Our swapchain layout is applied when our session is created
+	SwapchainLayout swapchain_layout_setting = SWAPCHAIN_LAYOUT_PER_VIEW;
+	SwapchainLayout swapchain_layout = SWAPCHAIN_LAYOUT_PER_VIEW;
+	uint32_t swapchain_count = 0;
+	int64_t swapchain_format = 0;
+
+	// Sample counts are configured per view and capped at what the runtime supports, applied when our session is (re)created.
+	// An empty setting uses the runtimes recommended sample count and leaves Godots MSAA setting alone.
+	MSAAMode msaa_mode_setting = MSAA_MODE_RESOLVE;
+	MSAAMode msaa_mode = MSAA_MODE_RESOLVE;
+	std::vector<uint32_t> sample_count_setting;
+	uint32_t *sample_counts = NULL; // per view
+	uint32_t *swapchain_sample_counts = NULL; // per swapchain, 1 unless we use native MSAA
+	uint32_t godot_msaa_samples = 0; // sample count we still need to apply to our viewport, 0 if nothing to apply
+	uint64_t swapchain_bytes_per_frame = 0; // for all our swapchain images we render into each frame, 0 if our format is unknown to us
+	SwapchainFormatPolicy format_policy;
+	int video_driver = 0; // OS::VIDEO_DRIVER_GLES3 or OS::VIDEO_DRIVER_GLES2
+	bool linear_output_pending = false; // we still need to tell our viewport to keep its output linear
 	XrSwapchainImageOpenGLKHR **images = NULL;
+	uint32_t *image_counts = NULL;
+	bool *image_acquired = NULL;
+	bool *image_waited = NULL; // xrWaitSwapchainImage succeeded for our acquired image
+	XrDuration swapchain_wait_timeout = 100000000; // 100ms in nanoseconds
+	GLsync *release_fences = NULL; // per swapchain, inserted when we release an image, NULL if we can't use fences
+	bool gpu_busy_at_acquire = false;
+	SwapchainWaitStats swapchain_wait_stats = {};
 	XrSwapchain *swapchains = NULL;
+	GLuint *layer_textures = NULL; // 2D views of each layer of our array images, [image * view_count + view]
+	CopyEngine copy_engine; // copies Godots render target into our swapchain when Godot can't render into it
+	CompositionLayers composition_layers; // extra layers we submit around our projection layer
+	std::vector<const XrCompositionLayerBaseHeader *> layers_behind;
+	std::vector<const XrCompositionLayerBaseHeader *> layers_in_front;
+	std::vector<const XrCompositionLayerBaseHeader *> frame_layers; // everything we submit with our frame, in order
+	bool projection_blend = false; // our viewport has a transparent background so we can blend over layers behind us
+	bool hold_frame = false; // Godot doesn't render, we keep submitting the last frame it rendered
+	bool projection_submitted = false; // our swapchains have a frame we can submit again
+	uint64_t held_frames = 0; // frames we submitted without Godot rendering them
+
+	// Depth swapchains for XR_KHR_composition_layer_depth, one for each colour swapchain and laid out the same way.
+	// These are only created when depth is enabled and supported, depth_swapchains is NULL otherwise.
+	bool use_depth_setting = false;
+	int64_t depth_format = 0;
+	XrSwapchain *depth_swapchains = NULL;
+	XrSwapchainImageOpenGLKHR **depth_images = NULL;
+	uint32_t *depth_image_counts = NULL;
+	uint32_t *depth_buffer_index = NULL;
+	bool *depth_acquired = NULL;
+	bool *depth_waited = NULL; // xrWaitSwapchainImage succeeded for our acquired depth image, tracked apart from colour
+	XrCompositionLayerDepthInfoKHR *depth_infos = NULL; // chained into projection_views[i].next for views we copied depth for
+	uint64_t depth_frames = 0; // frames we submitted depth with
 	uint32_t view_count;
 	XrViewConfigurationView *configuration_views = NULL;
-	// GLuint** framebuffers;
-	// GLuint depthbuffer;
+
+	// Our swapchains are allocated once at our maximum render scale, we render into the bottom left
+	// render_width x render_height of each image and submit that as our imageRect.
+	uint32_t swapchain_width = 0;
+	uint32_t swapchain_height = 0;
+	uint32_t render_width = 0;
+	uint32_t render_height = 0;
+	DynamicResolution dynamic_resolution;
+	uint64_t frame_work_start_usec = 0; // when we got our frame from xrWaitFrame, main thread only
+
+	// Framebuffers for each of our swapchain images built once our images are known, one per layer for array images.
+	// [swapchain][image * array size + layer], 0 for images we couldn't build a complete framebuffer for.
+	GLuint **framebuffers = NULL;
+	GLuint **depth_framebuffers = NULL;
+	uint32_t framebuffer_layers = 1;
 
 	XrCompositionLayerProjection *projectionLayer = NULL;
 	XrFrameState frameState = {};
 	bool running;
+	bool frame_in_progress = false; // xrBeginFrame was called for frameState and we haven't called xrEndFrame yet
+
+	// When the runtime tells us not to render we disable updates on our ARVR viewport so Godot doesn't render it
+	bool render_skipped = false;
+	int64_t skipped_viewport_update_mode = godot::Viewport::UPDATE_ALWAYS;
 
 	XrSessionState state;
-	bool view_pose_valid = false;
+
+	// While our session isn't running we skip polling for events on Godots ticks until idle_next_poll_usec,
+	// doubling the interval up to our maximum. We never block ourselves, instead we put Godot in low processor
+	// usage mode so its main loop sleeps idle_max_sleep_usec between iterations, and restore it once we run again.
+	uint64_t idle_backoff_usec = 0;
+	uint64_t idle_next_poll_usec = 0;
+	uint64_t idle_max_sleep_usec = 20000;
+	bool idle_throttled = false;
+	bool saved_low_processor_mode = false;
+	int64_t saved_low_processor_sleep_usec = 0;
 
 	uint32_t *buffer_index = NULL;
 
-	XrView *views = NULL;
+	// Everything we track is located once per frame at frameState.predictedDisplayTime
+	// and stored here, all getters read from this snapshot so head, eyes and hands
+	// agree with each other within a frame.
+	struct TrackingSnapshot {
+		uint64_t frame_id; // increases every time we locate
+		XrTime display_time; // 0 until we've located for the first time
+
+		XrView *views;
+		bool view_pose_valid;
+		bool views_located_early; // pipelined, our frame thread located our views while the previous frame rendered
+
+		XrSpaceLocation head;
+		bool head_valid;
+
+		XrSpaceLocation hands[HANDCOUNT];
+		bool hand_valid[HANDCOUNT];
+	};
+	TrackingSnapshot tracking = {};
+
+	// When late latching we locate our views again right before Godot renders them and
+	// use those poses both for rendering and for submitting our projection layer.
+	// Only our views are latched again: Godot has already placed our head and controller nodes by the
+	// time it renders, so hands (and anything attached to our ARVRCamera) keep the earlier sample.
+	// When pipelined our views were located a frame early so we always latch them again, late_latch or not.
+	bool late_latch = false;
+	uint64_t late_latched_frame_id = 0;
+	XrView *late_latch_views = NULL;
+	PoseDeltaStats late_latch_stats = {};
+
 	XrCompositionLayerProjectionView *projection_views = NULL;
 
-	XrActionSet actionSet;
+	XrActionSet actionSet = XR_NULL_HANDLE;
 	XrAction actions[LAST_ACTION_INDEX];
 	XrPath handPaths[HANDCOUNT];
-	XrSpace handSpaces[HANDCOUNT];
+	XrSpace handSpaces[HANDCOUNT] = {};
 
 	godot_int godot_controllers[2];
 
 	bool monado_stick_on_ball_ext;
+	bool composition_layer_depth_ext = false;
+	bool visibility_mask_ext = false;
+	bool composition_layer_cylinder_ext = false;
+	bool composition_layer_cube_ext = false;
+	bool composition_layer_equirect2_ext = false;
+	bool color_scale_bias_ext = false;
+	VisibilityMask visibility_mask; // fetched when our session is created and refreshed when the runtime tells us they changed
+
+	// used to convert runtime time to our monotonic clock
+#ifdef WIN32
+	PFN_xrConvertTimeToWin32PerformanceCounterKHR xrConvertTimeToWin32PerformanceCounterKHR_ptr = NULL;
+#else
+	PFN_xrConvertTimeToTimespecTimeKHR xrConvertTimeToTimespecTimeKHR_ptr = NULL;
+#endif
 
-	bool is_successful_init();
+	DeadlineStats deadline_stats = {};
+	XrTime last_display_time = 0;
+
+	// Optional frame pacing thread that owns xrWaitFrame/xrBeginFrame so our main thread doesn't block on them.
+	// Per frame state is handed to the main thread through a lock free triple buffer of frame slots, frame_thread_slot
+	// holds the index of the last published slot with FRAME_SLOT_NEW set until the main thread picks it up.
+	//
+	// In pipelined mode our frame thread also locates our views and head for the next frame while the main
+	// thread is still rendering the current one and the main thread calls xrBeginFrame when it picks up the slot.
+	// OpenXR allows only one frame that has been waited for but not begun, so two frames are in flight at most.
+	enum {
+		FRAME_SLOT_COUNT = 3,
+		FRAME_SLOT_NEW = 0x4
+	};
+	struct FrameSlot {
+		XrFrameState frame_state;
+
+		bool tracking_located; // only set in pipelined mode
+		XrView *views;
+		bool view_pose_valid;
+		XrSpaceLocation head;
+		bool head_valid;
+	};
+	bool use_frame_thread = false;
+	bool use_pipelining = false;
+	bool frame_thread_pipelined; // use_pipelining when our frame thread was started
+	std::thread frame_thread;
+	std::atomic<bool> frame_thread_active;
+	FrameSlot frame_slots[FRAME_SLOT_COUNT];
+	std::atomic<int> frame_thread_slot;
+	int frame_thread_front; // only accessed from the main thread
+	int frame_thread_back; // only accessed from the frame thread
+	std::mutex frame_sync_mutex;
+	std::condition_variable frame_sync_condition;
+	std::atomic<uint64_t> frames_ended; // our frame thread begins the next frame once the previous one has ended
+	std::atomic<uint64_t> frames_begun_on_main; // pipelined, our frame thread waits for the next frame once this one has begun
+	std::atomic<uint64_t> frame_thread_begin_failures; // xrBeginFrame failures on our frame thread not yet added to our deadline stats
+
+	TimingCounter wait_frame_timing; // time spent in xrWaitFrame, on whichever thread calls it
+	TimingCounter process_timing; // time spent in process_openxr() on the main thread
+	uint64_t frames_missed; // process_openxr() found no new frame from our frame thread
+
+	FrameTimings frame_timings; // when each phase of our recent frames happened, main thread only
 
 	template <class... Args>
 	bool xr_result(XrResult result, const char *format, Args... values);
@@ -126,8 +413,56 @@ private:
 	XrAction createAction(XrActionType actionType, const char *actionName, const char *localizedActionName);
 	XrResult getActionStates(XrAction action, XrStructureType actionStateType, void *states);
 	bool suggestActions(const char *interaction_profile, XrAction *actions, XrPath **paths, int num_actions);
-	XrResult acquire_image(int eye);
+	bool create_instance();
+	void destroy_instance();
+	bool create_session();
+	void destroy_session();
+	void on_lost(bool p_instance);
+	void recover();
+	bool get_system(); // (re)fetches our systemId and checks its graphics requirements
+	bool begin_session();
+	void end_session();
+	void on_state_changed(XrSessionState p_state);
+	void start_frame_thread();
+	void stop_frame_thread();
+	void frame_thread_func();
+	FrameSlot *acquire_frame_from_thread();
+	void end_frame(uint32_t layer_count, const XrCompositionLayerBaseHeader *const *layers);
+	bool xr_time_to_usec(XrTime p_time, uint64_t *r_usec);
+	bool update_deadline_stats(uint64_t p_submit_usec);
+	void update_render_size();
+	godot::Viewport *get_arvr_viewport();
+	bool set_render_skipped(bool p_skip);
+	void submit_frame();
+	void idle_backoff();
+	void set_idle_throttle(bool p_throttle);
+	bool poll_events();
+	void process_events();
+	uint32_t get_swapchain_for_eye(int eye) const { return swapchain_count < view_count ? 0 : eye; }
+	XrResult acquire_image(int eye, bool p_block);
+	void acquire_images();
+	void record_image_wait(uint64_t p_usec);
+	void check_release_fences();
+	void free_release_fences();
+	XrResult release_image(int eye);
+	bool create_depth_swapchains(const int64_t *p_formats, uint32_t p_format_count, uint32_t p_array_size, uint32_t p_image_width);
+	void free_depth_swapchains();
+	void copy_depth_to_swapchain(int eye, uint32_t texid);
+	void create_layer_textures();
+	void free_layer_textures();
+	void copy_to_swapchain(int eye, uint32_t texid);
+	void setup_sample_counts();
+	bool is_multisampled(uint32_t p_swapchain) const { return swapchain_sample_counts != NULL && swapchain_sample_counts[p_swapchain] > 1; }
+	void create_framebuffers();
+	void free_framebuffers();
+	GLuint **create_framebuffer_cache(GLenum p_attachment, XrSwapchainImageOpenGLKHR **p_images, const uint32_t *p_image_counts);
+	void free_framebuffer_cache(GLuint **p_cache, const uint32_t *p_image_counts);
 	bool transform_from_pose(godot_transform *p_dest, XrPosef *pose, float p_world_scale);
+	void sync_actions();
+	bool locate_views(XrTime p_time, XrView *r_views);
+	bool locate_head(XrTime p_time, XrSpaceLocation *r_location);
+	void locate_tracking(const FrameSlot *p_slot);
+	void late_latch_tracking();
 	void update_controllers();
 	void transform_from_matrix(godot_transform *p_dest, XrMatrix4x4f *matrix, float p_world_scale);
 
@@ -135,9 +470,109 @@ public:
 	static OpenXRApi *openxr_get_api();
 	static void openxr_release_api();
 
+	// returns our monotonic clock (CLOCK_MONOTONIC on Linux, the performance counter on Windows) in microseconds
+	static uint64_t get_time_usec();
+
 	OpenXRApi();
 	~OpenXRApi();
 
+	// initialize() sets up our OpenXR instance and session, uninitialize() tears everything down again
+	bool initialize();
+	void uninitialize();
+	bool is_successful_init();
+
+	// How we lay out our swapchains, applied when our session is (re)created
+	SwapchainLayout get_swapchain_layout() const { return swapchain_layout_setting; }
+	void set_swapchain_layout(SwapchainLayout p_layout);
+
+	// How we copy Godots render target into our swapchain when Godot can't render into it directly
+	CopyEngine::Method get_copy_method() const { return copy_engine.get_requested_method(); }
+	void set_copy_method(CopyEngine::Method p_method) { copy_engine.set_requested_method(p_method); }
+	CopyEngine::Method get_selected_copy_method() const { return copy_engine.get_selected_method(); }
+
+	// Measures each copy method, must be called with Godots GL context current
+	void benchmark_copy(uint32_t p_width, uint32_t p_height, int p_iterations, uint64_t *r_usec);
+
+	// Ordered swapchain format preferences, an empty list selects the default order for Godots video driver.
+	// Applied when our session is (re)created.
+	const SwapchainFormatPolicy &get_format_policy() const { return format_policy; }
+	void set_swapchain_formats(const SwapchainFormatPolicy::Format *p_formats, int p_count);
+	int64_t get_swapchain_format() const { return swapchain_format; }
+	uint64_t get_swapchain_bytes_per_frame() const { return swapchain_bytes_per_frame; }
+
+	// How we anti-alias, applied when our session is (re)created
+	MSAAMode get_msaa_mode() const { return msaa_mode_setting; }
+	void set_msaa_mode(MSAAMode p_mode);
+	const std::vector<uint32_t> &get_sample_counts() const { return sample_count_setting; }
+	void set_sample_counts(const std::vector<uint32_t> &p_counts);
+	uint32_t get_view_sample_count(uint32_t p_view) const { return sample_counts != NULL && p_view < view_count ? sample_counts[p_view] : 0; }
+	CopyEngine *get_copy_engine() { return &copy_engine; }
+
+	// Quad layers and friends, each layer is only copied into its swapchain when its source changes
+	CompositionLayers *get_composition_layers() { return &composition_layers; }
+
+	// Stop Godot from rendering and resubmit the last frame it rendered, i.e. during a scene load while we fade it out.
+	// The runtime still reprojects it with the poses it was rendered with, our other layers keep updating.
+	bool get_hold_frame() const { return hold_frame; }
+	void set_hold_frame(bool p_hold) { hold_frame = p_hold; }
+	uint64_t get_held_frames() const { return held_frames; }
+
+	// Areas of each view the lenses never show, empty if the runtime doesn't support XR_KHR_visibility_mask
+	const VisibilityMask &get_visibility_mask() const { return visibility_mask; }
+
+	// Submit depth with our projection layer so the runtime can do positional reprojection, applied when our session is (re)created
+	bool get_use_depth() const { return use_depth_setting; }
+	void set_use_depth(bool p_enable);
+	bool is_depth_submitted() const { return depth_swapchains != NULL; }
+	uint64_t get_depth_frames() const { return depth_frames; }
+
+	// Run xrWaitFrame/xrBeginFrame on a separate thread, must be set before initialize() is called
+	bool get_use_frame_thread() const { return use_frame_thread; }
+	void set_use_frame_thread(bool p_enable);
+
+	// Let our frame thread prepare the next frame while we render the current one, requires our frame thread
+	bool get_use_pipelining() const { return use_pipelining; }
+	void set_use_pipelining(bool p_enable);
+
+	// Scale our render resolution to hold our frame rate, our maximum scale must be set before initialize() is called
+	DynamicResolution *get_dynamic_resolution() { return &dynamic_resolution; }
+	void set_max_render_scale(float p_scale);
+
+	const TimingCounter &get_wait_frame_timing() const { return wait_frame_timing; }
+	const TimingCounter &get_process_timing() const { return process_timing; }
+	uint64_t get_frames_missed() const { return frames_missed; }
+	void reset_frame_timing();
+	FrameTimings *get_frame_timings() { return &frame_timings; }
+
+	// Events are delivered as signals on registered objects, see OpenXREvents
+	int get_event_budget() const { return event_budget; }
+	void set_event_budget(int p_budget) { event_budget = p_budget > 0 ? p_budget : 0; }
+	uint64_t get_events_dropped() const { return event_queue.get_dropped(); }
+	void register_event_listener(godot::Object *p_listener);
+	void unregister_event_listener(godot::Object *p_listener);
+
+	const RecoveryStats &get_recovery_stats() const { return recovery_stats; }
+	void reset_recovery_stats() { recovery_stats = {}; }
+
+	// How long we wait for our swapchain images to become available, applies to our next wait
+	uint64_t get_swapchain_wait_timeout_usec() const { return (uint64_t)swapchain_wait_timeout / 1000; }
+	void set_swapchain_wait_timeout_usec(uint64_t p_usec);
+	const SwapchainWaitStats &get_swapchain_wait_stats() const { return swapchain_wait_stats; }
+	void reset_swapchain_wait_stats() { swapchain_wait_stats = {}; }
+
+	const DeadlineStats &get_deadline_stats() const { return deadline_stats; }
+	void reset_deadline_stats();
+
+	// How long we may sleep between polling for events while our session isn't running
+	int get_idle_max_sleep_msec() const { return (int)(idle_max_sleep_usec / 1000); }
+	void set_idle_max_sleep_msec(int p_msec);
+
+	// Locate our views again right before rendering, can be changed at any time
+	bool get_late_latch() const { return late_latch; }
+	void set_late_latch(bool p_enable) { late_latch = p_enable; }
+	const PoseDeltaStats &get_late_latch_stats() const { return late_latch_stats; }
+	void reset_late_latch_stats() { late_latch_stats = {}; }
+
 	/* render_openxr() should be called once per eye.
 	 *
 	 * If has_external_texture_support it assumes godot has finished rendering into
@@ -150,13 +585,13 @@ public:
 	// fill_projection_matrix() should be called after process_openxr()
 	void fill_projection_matrix(int eye, godot_real p_z_near, godot_real p_z_far, godot_real *p_projection);
 
-	// recommended_rendertarget_size() returns required size of our image buffers
+	// recommended_rendertarget_size() returns the size Godot should render at this frame
 	void recommended_rendertarget_size(uint32_t *width, uint32_t *height);
 
-	// get_view_transform() should be called after fill_projection_matrix()
+	// get_view_transform() returns the eye pose from this frame's tracking snapshot
 	bool get_view_transform(int eye, float world_scale, godot_transform *transform_for_eye);
 
-	// get_head_center() can be called at any time after init
+	// get_head_center() returns the head pose from this frame's tracking snapshot
 	bool get_head_center(float world_scale, godot_transform *transform);
 
 	// get_external_texture_for_eye() acquires images and sets has_support to true
@@ -0,0 +1,357 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Streams CPU written frames into a texture through a ring of pixel buffer objects
+
+#include "StreamUploader.h"
+#include "OpenXRApi.h"
+
+#include <string.h>
+
+using namespace godot;
+
+StreamUploader::StreamUploader() {
+	for (int i = 0; i < RING_SIZE; i++) {
+		slots[i].buffer = 0;
+		slots[i].mapped = NULL;
+		slots[i].state = SLOT_FREE;
+		slots[i].fence = 0;
+		slots[i].sequence = 0;
+	}
+	writing = -1;
+	width = 0;
+	height = 0;
+	frame_size = 0;
+	persistent = false;
+	next_sequence = 1;
+	stats = {};
+}
+
+StreamUploader::~StreamUploader() {
+	// our GL context may well be gone by now, cleanup() should have been called while it was current
+}
+
+bool StreamUploader::is_persistent_supported() {
+#ifdef WIN32
+	// glad only gives us GL 3.3
+	return false;
+#else
+	return CopyEngine::is_gl_version_at_least(4, 4) || CopyEngine::has_extension("GL_ARB_buffer_storage");
+#endif
+}
+
+bool StreamUploader::setup(uint32_t p_width, uint32_t p_height) {
+	cleanup();
+
+	width = p_width;
+	height = p_height;
+	frame_size = (size_t)p_width * p_height * 4;
+	persistent = is_persistent_supported();
+
+	GLint unpack_buffer;
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack_buffer);
+
+	for (int i = 0; i < RING_SIZE; i++) {
+		Slot &slot = slots[i];
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+#ifndef WIN32
+		if (persistent) {
+			// coherent so whatever our writer puts in is visible to our GPU without us flushing anything
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, frame_size, NULL, flags);
+			slot.mapped = (uint8_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frame_size, flags);
+		}
+#endif
+		if (!persistent) {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, frame_size, NULL, GL_STREAM_DRAW);
+			slot.staging.resize(frame_size);
+			slot.mapped = slot.staging.data();
+		}
+		slot.state = SLOT_FREE;
+
+		if (slot.mapped == NULL) {
+			Godot::print("OpenXR couldn't map our stream buffers");
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+			cleanup();
+			return false;
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+	Godot::print("OpenXR streaming {0}x{1} frames through {2} {3} buffers", (int64_t)width, (int64_t)height, (int64_t)RING_SIZE, persistent ? "persistently mapped" : "staged");
+
+	return true;
+}
+
+void StreamUploader::cleanup() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (int i = 0; i < RING_SIZE; i++) {
+		Slot &slot = slots[i];
+		if (slot.fence != 0) {
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+		}
+		if (slot.buffer != 0) {
+			if (persistent && slot.mapped != NULL) {
+				GLint unpack_buffer;
+				glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack_buffer);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+			}
+			glDeleteBuffers(1, &slot.buffer);
+			slot.buffer = 0;
+		}
+		slot.mapped = NULL;
+		slot.staging.clear();
+		slot.state = SLOT_FREE;
+	}
+
+	writing = -1;
+	width = 0;
+	height = 0;
+	frame_size = 0;
+}
+
+void StreamUploader::reclaim(bool p_wait) {
+	// our GPU reads our buffers in the order we uploaded them
+	int oldest = -1;
+	for (int i = 0; i < RING_SIZE; i++) {
+		Slot &slot = slots[i];
+		if (slot.state != SLOT_IN_FLIGHT) {
+			continue;
+		}
+
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			slot.state = SLOT_FREE;
+		} else if (oldest < 0 || slot.sequence < slots[oldest].sequence) {
+			oldest = i;
+		}
+	}
+
+	if (p_wait && oldest >= 0) {
+		// 100ms, if our GPU takes longer than that we have bigger problems
+		glClientWaitSync(slots[oldest].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+		glDeleteSync(slots[oldest].fence);
+		slots[oldest].fence = 0;
+		slots[oldest].state = SLOT_FREE;
+	}
+}
+
+uint8_t *StreamUploader::begin_write() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (frame_size == 0 || writing >= 0) {
+		return NULL;
+	}
+
+	// a free buffer, or else the oldest frame nobody uploaded yet, our newest frame always wins
+	int slot = -1;
+	for (int i = 0; i < RING_SIZE && slot < 0; i++) {
+		if (slots[i].state == SLOT_FREE) {
+			slot = i;
+		}
+	}
+	if (slot < 0) {
+		for (int i = 0; i < RING_SIZE; i++) {
+			if (slots[i].state == SLOT_READY && (slot < 0 || slots[i].sequence < slots[slot].sequence)) {
+				slot = i;
+			}
+		}
+	}
+	if (slot < 0) {
+		stats.writes_refused++;
+		return NULL;
+	}
+
+	if (slots[slot].state == SLOT_READY) {
+		stats.frames_dropped++;
+	}
+	slots[slot].state = SLOT_WRITING;
+	writing = slot;
+
+	return slots[slot].mapped;
+}
+
+void StreamUploader::end_write(bool p_commit) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (writing < 0) {
+		return;
+	}
+
+	if (p_commit) {
+		slots[writing].state = SLOT_READY;
+		slots[writing].sequence = next_sequence++;
+		stats.frames_written++;
+	} else {
+		slots[writing].state = SLOT_FREE;
+	}
+	writing = -1;
+}
+
+bool StreamUploader::write_frame(const uint8_t *p_data, size_t p_size) {
+	if (p_size != frame_size) {
+		Godot::print("OpenXR stream frame is {0} bytes, expected {1}", (int64_t)p_size, (int64_t)frame_size);
+		return false;
+	}
+
+	uint8_t *dst = begin_write();
+	if (dst == NULL) {
+		return false;
+	}
+
+	// our one copy of this frame, flipped into GLs bottom up row order on the way
+	size_t row_size = (size_t)width * 4;
+	for (uint32_t y = 0; y < height; y++) {
+		memcpy(dst + (height - 1 - y) * row_size, p_data + y * row_size, row_size);
+	}
+
+	end_write(true);
+	return true;
+}
+
+bool StreamUploader::has_pending() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i = 0; i < RING_SIZE; i++) {
+		if (slots[i].state == SLOT_READY) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool StreamUploader::upload(GLuint p_texture) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t start = OpenXRApi::get_time_usec();
+
+	reclaim(false);
+
+	int newest = -1;
+	for (int i = 0; i < RING_SIZE; i++) {
+		if (slots[i].state == SLOT_READY && (newest < 0 || slots[i].sequence > slots[newest].sequence)) {
+			newest = i;
+		}
+	}
+	if (newest < 0) {
+		return false;
+	}
+	for (int i = 0; i < RING_SIZE; i++) {
+		if (i != newest && slots[i].state == SLOT_READY) {
+			// we're late, showing an older frame now only adds latency
+			slots[i].state = SLOT_FREE;
+			stats.frames_dropped++;
+		}
+	}
+
+	Slot &slot = slots[newest];
+
+	// remember everything we change, Godot tracks some of this state itself
+	GLint unpack_buffer, texture, alignment, row_length;
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack_buffer);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glGetIntegerv(GL_UNPACK_ROW_LENGTH, &row_length);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	if (!persistent) {
+		// orphans our old storage so we never wait on our GPU still reading it
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, frame_size, slot.staging.data(), GL_STREAM_DRAW);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glBindTexture(GL_TEXTURE_2D, p_texture);
+
+	// with a pixel buffer bound this returns right away, our GPU pulls the data over when it gets to it
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (const void *)0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = SLOT_IN_FLIGHT;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+
+	stats.frames_uploaded++;
+	stats.last_upload_usec = OpenXRApi::get_time_usec() - start;
+	return true;
+}
+
+bool StreamUploader::benchmark(uint32_t p_width, uint32_t p_height, int p_frames, BenchmarkResults *r_results) {
+	*r_results = {};
+	if (p_frames < 1) {
+		p_frames = 1;
+	}
+
+	StreamUploader uploader;
+	if (!uploader.setup(p_width, p_height)) {
+		return false;
+	}
+
+	GLint binding, unpack_buffer;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack_buffer);
+
+	// our target is set up like an equirect swapchain image
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, p_width, p_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, binding);
+
+	// Every byte of every frame is written like a decoder would, a different value each frame so nothing can be skipped
+	uint64_t write_usec = 0;
+	uint64_t upload_usec = 0;
+	uint64_t start = OpenXRApi::get_time_usec();
+	for (int i = 0; i < p_frames; i++) {
+		uint8_t *dst = uploader.begin_write();
+		while (dst == NULL) {
+			// every buffer is still being read, this is where our decoder would be held up by our GPU
+			uint64_t stall_start = OpenXRApi::get_time_usec();
+			{
+				std::lock_guard<std::mutex> lock(uploader.mutex);
+				uploader.reclaim(true);
+			}
+			r_results->stall_usec += OpenXRApi::get_time_usec() - stall_start;
+			dst = uploader.begin_write();
+		}
+
+		// stalls are counted on their own
+		uint64_t write_start = OpenXRApi::get_time_usec();
+		memset(dst, i & 0xFF, uploader.frame_size);
+		uploader.end_write(true);
+
+		uint64_t upload_start = OpenXRApi::get_time_usec();
+		write_usec += upload_start - write_start;
+		uploader.upload(texture);
+		upload_usec += OpenXRApi::get_time_usec() - upload_start;
+	}
+	glFinish();
+	r_results->total_usec = OpenXRApi::get_time_usec() - start;
+	r_results->write_usec = write_usec / p_frames;
+	r_results->upload_usec = upload_usec / p_frames;
+
+	// what we'd do without our buffers, the driver copies each frame before glTexSubImage2D returns
+	std::vector<uint8_t> frame(uploader.frame_size);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	start = OpenXRApi::get_time_usec();
+	for (int i = 0; i < p_frames; i++) {
+		memset(frame.data(), i & 0xFF, frame.size());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p_width, p_height, GL_RGBA, GL_UNSIGNED_BYTE, frame.data());
+	}
+	glFinish();
+	r_results->direct_usec = OpenXRApi::get_time_usec() - start;
+
+	glBindTexture(GL_TEXTURE_2D, binding);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+	glDeleteTextures(1, &texture);
+	uploader.cleanup();
+
+	return true;
+}
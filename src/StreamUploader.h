@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Streams CPU written frames into a texture through a ring of pixel buffer objects
+
+#ifndef STREAM_UPLOADER_H
+#define STREAM_UPLOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "CopyEngine.h"
+
+class StreamUploader {
+public:
+	enum {
+		RING_SIZE = 3 // one being written, one waiting for upload and one the GPU is reading
+	};
+
+	struct Stats {
+		uint64_t frames_written; // frames our writer committed
+		uint64_t frames_uploaded; // frames we handed to our GPU
+		uint64_t frames_dropped; // frames replaced by a newer frame before we uploaded them
+		uint64_t writes_refused; // begin_write() found every buffer busy
+		uint64_t last_upload_usec; // CPU time of our last upload() call
+	};
+
+	struct BenchmarkResults {
+		uint64_t write_usec; // average CPU time writing a frame into mapped memory
+		uint64_t upload_usec; // average CPU time issuing the upload of a frame
+		uint64_t stall_usec; // total time we waited for our GPU to free a buffer
+		uint64_t total_usec; // everything, including waiting for our GPU to finish
+		uint64_t direct_usec; // the same frames uploaded with glTexSubImage2D from client memory
+	};
+
+private:
+	enum SlotState {
+		SLOT_FREE,
+		SLOT_WRITING, // handed out by begin_write()
+		SLOT_READY, // written, waiting for upload()
+		SLOT_IN_FLIGHT // uploaded, our GPU may still be reading it until our fence signals
+	};
+
+	struct Slot {
+		GLuint buffer;
+		uint8_t *mapped; // persistently mapped buffer, or our staging memory if we can't map persistently
+		std::vector<uint8_t> staging;
+		SlotState state;
+		GLsync fence;
+		uint64_t sequence; // order frames were committed in
+	};
+
+	std::mutex mutex; // our writer may be on another thread if we're persistently mapped
+	Slot slots[RING_SIZE];
+	int writing; // slot handed out by begin_write(), -1 if none
+	uint32_t width;
+	uint32_t height;
+	size_t frame_size;
+	bool persistent;
+	uint64_t next_sequence;
+	Stats stats;
+
+	void reclaim(bool p_wait);
+
+public:
+	StreamUploader();
+	~StreamUploader();
+
+	// GL_ARB_buffer_storage, without it our writer fills staging memory that we copy into our buffer when we upload
+	static bool is_persistent_supported();
+
+	// Creates our buffers for p_width x p_height RGBA8 frames, must be called with our GL context current
+	bool setup(uint32_t p_width, uint32_t p_height);
+	void cleanup();
+
+	uint32_t get_width() const { return width; }
+	uint32_t get_height() const { return height; }
+	size_t get_frame_size() const { return frame_size; }
+	bool is_persistent() const { return persistent; }
+
+	// Returns memory for one RGBA8 frame, rows bottom up as GL expects them, or NULL if every buffer is busy.
+	// When we're persistently mapped this may be called from any thread, it's our decoder writing straight into our buffer.
+	uint8_t *begin_write();
+	void end_write(bool p_commit);
+
+	// Writes a frame with rows top down, which is what decoders and Godot images give us
+	bool write_frame(const uint8_t *p_data, size_t p_size);
+
+	bool has_pending();
+
+	// Uploads the newest committed frame into p_texture, a GL_TEXTURE_2D of our size. Frames committed before it are dropped.
+	// Must be called with our GL context current, returns false if we had nothing new.
+	bool upload(GLuint p_texture);
+
+	const Stats &get_stats() const { return stats; }
+
+	// Feeds p_frames synthetic frames through a ring of our own into a texture we create, must be called with our GL context current
+	static bool benchmark(uint32_t p_width, uint32_t p_height, int p_frames, BenchmarkResults *r_results);
+};
+
+#endif /* !STREAM_UPLOADER_H */
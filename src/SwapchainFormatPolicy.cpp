@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Picks the colour format of our swapchains from an ordered list of preferences
+
+#include "SwapchainFormatPolicy.h"
+
+#ifdef WIN32
+#include <glad/glad.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+static const SwapchainFormatPolicy::FormatInfo format_info[SwapchainFormatPolicy::FORMAT_MAX] = {
+	{ GL_SRGB8_ALPHA8, "SRGB8_ALPHA8", 4, false },
+	{ GL_RGBA8, "RGBA8", 4, false },
+	{ GL_RGB10_A2, "RGB10_A2", 4, false },
+	{ GL_R11F_G11F_B10F, "R11F_G11F_B10F", 4, true },
+	{ GL_RGBA16F, "RGBA16F", 8, true },
+};
+
+SwapchainFormatPolicy::SwapchainFormatPolicy() {
+	preference_count = 0;
+}
+
+const SwapchainFormatPolicy::FormatInfo &SwapchainFormatPolicy::get_info(Format p_format) {
+	return format_info[p_format];
+}
+
+bool SwapchainFormatPolicy::is_supported_by_driver(Format p_format, Driver p_driver) {
+	// GLES2 renders straight into an 8 bit per channel buffer in sRGB space, anything wider only costs bandwidth
+	// and it can't keep its output linear for the float formats.
+	if (p_driver == DRIVER_GLES2) {
+		return p_format == FORMAT_SRGB8_ALPHA8 || p_format == FORMAT_RGBA8;
+	}
+
+	return true;
+}
+
+bool SwapchainFormatPolicy::has_alpha(int64_t p_gl_format) {
+	return p_gl_format != GL_R11F_G11F_B10F;
+}
+
+void SwapchainFormatPolicy::set_preferences(const Format *p_formats, int p_count) {
+	preference_count = 0;
+	for (int i = 0; i < p_count && preference_count < FORMAT_MAX; i++) {
+		if (p_formats[i] < 0 || p_formats[i] >= FORMAT_MAX) {
+			continue;
+		}
+
+		// ignore duplicates, only the first mention counts
+		bool duplicate = false;
+		for (int j = 0; j < preference_count; j++) {
+			duplicate = duplicate || preferences[j] == p_formats[i];
+		}
+		if (!duplicate) {
+			preferences[preference_count++] = p_formats[i];
+		}
+	}
+}
+
+int SwapchainFormatPolicy::get_candidates(Driver p_driver, bool p_allow_linear, Format *r_formats) const {
+	int count = 0;
+
+	// Godots own render target is 8 or 10 bits per channel, if we copy from it linear colour bands in the dark,
+	// a float format only pays off if Godot writes its linear output straight into our swapchain.
+	if (preference_count > 0) {
+		for (int i = 0; i < preference_count; i++) {
+			if (is_supported_by_driver(preferences[i], p_driver) && (p_allow_linear || !format_info[preferences[i]].linear)) {
+				r_formats[count++] = preferences[i];
+			}
+		}
+	} else {
+		// Our default order: Godot hands us sRGB encoded 8 bit colour so formats that store exactly that come first
+		for (int f = 0; f < FORMAT_MAX; f++) {
+			if (is_supported_by_driver((Format)f, p_driver) && (p_allow_linear || !format_info[f].linear)) {
+				r_formats[count++] = (Format)f;
+			}
+		}
+	}
+
+	return count;
+}
+
+int SwapchainFormatPolicy::select(Driver p_driver, bool p_allow_linear, const int64_t *p_runtime_formats, uint32_t p_runtime_format_count, Format *r_format) const {
+	Format candidates[FORMAT_MAX];
+	int candidate_count = get_candidates(p_driver, p_allow_linear, candidates);
+
+	// our order decides, not the order the runtime lists its formats in
+	for (int c = 0; c < candidate_count; c++) {
+		for (uint32_t i = 0; i < p_runtime_format_count; i++) {
+			if (p_runtime_formats[i] == format_info[candidates[c]].gl_format) {
+				*r_format = candidates[c];
+				return (int)i;
+			}
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Picks the colour format of our swapchains from an ordered list of preferences
+
+#ifndef SWAPCHAIN_FORMAT_POLICY_H
+#define SWAPCHAIN_FORMAT_POLICY_H
+
+#include <stdint.h>
+
+class SwapchainFormatPolicy {
+public:
+	enum Format {
+		FORMAT_SRGB8_ALPHA8,
+		FORMAT_RGBA8,
+		FORMAT_RGB10_A2,
+		FORMAT_R11F_G11F_B10F,
+		FORMAT_RGBA16F,
+		FORMAT_MAX
+	};
+
+	enum Driver {
+		DRIVER_GLES3, // matches OS::VIDEO_DRIVER_GLES3
+		DRIVER_GLES2
+	};
+
+	struct FormatInfo {
+		int64_t gl_format;
+		const char *name;
+		uint32_t bytes_per_pixel;
+		bool linear; // the runtime expects linear colour, Godot needs to skip its sRGB conversion
+	};
+
+private:
+	Format preferences[FORMAT_MAX];
+	int preference_count; // 0 means we use the default for our driver
+
+public:
+	SwapchainFormatPolicy();
+
+	static const FormatInfo &get_info(Format p_format);
+	static bool is_supported_by_driver(Format p_format, Driver p_driver);
+	// false for formats we can't blend with the layers behind us
+	static bool has_alpha(int64_t p_gl_format);
+
+	// Our preferences in order, formats our driver can't render into are skipped when we select
+	int get_preference_count() const { return preference_count; }
+	Format get_preference(int p_index) const { return preferences[p_index]; }
+	void set_preferences(const Format *p_formats, int p_count);
+	void clear_preferences() { preference_count = 0; }
+
+	// Fills r_formats with the formats we'd accept for p_driver in order of preference, returns how many there are.
+	// Linear formats are only accepted if p_allow_linear, i.e. Godot renders straight into our swapchain.
+	int get_candidates(Driver p_driver, bool p_allow_linear, Format *r_formats) const;
+
+	// Returns the index into p_runtime_formats of the format we want, or -1 if the runtime supports none of them
+	int select(Driver p_driver, bool p_allow_linear, const int64_t *p_runtime_formats, uint32_t p_runtime_format_count, Format *r_format) const;
+};
+
+#endif /* !SWAPCHAIN_FORMAT_POLICY_H */
@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache of the meshes XR_KHR_visibility_mask gives us for each view
+
+#include "VisibilityMask.h"
+
+static const XrVisibilityMaskTypeKHR mask_types[VisibilityMask::TYPE_MAX] = {
+	XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+	XR_VISIBILITY_MASK_TYPE_VISIBLE_TRIANGLE_MESH_KHR,
+	XR_VISIBILITY_MASK_TYPE_LINE_LOOP_KHR
+};
+
+VisibilityMask::VisibilityMask() {
+	get_visibility_mask_ptr = NULL;
+}
+
+XrResult VisibilityMask::setup(XrInstance p_instance, uint32_t p_view_count) {
+	clear();
+
+	XrResult result = xrGetInstanceProcAddr(p_instance, "xrGetVisibilityMaskKHR", (PFN_xrVoidFunction *)&get_visibility_mask_ptr);
+	if (XR_FAILED(result)) {
+		get_visibility_mask_ptr = NULL;
+		return result;
+	}
+
+	meshes.resize(p_view_count * TYPE_MAX);
+	versions.resize(p_view_count, 0);
+	return XR_SUCCESS;
+}
+
+void VisibilityMask::clear() {
+	get_visibility_mask_ptr = NULL;
+	meshes.clear();
+	versions.clear();
+}
+
+XrResult VisibilityMask::fetch_mesh(XrSession p_session, uint32_t p_view, Type p_type) {
+	Mesh &mesh = meshes[p_view * TYPE_MAX + p_type];
+
+	// ask for our sizes first, then for our data
+	XrVisibilityMaskKHR mask = {
+		.type = XR_TYPE_VISIBILITY_MASK_KHR,
+		.next = NULL,
+		.vertexCapacityInput = 0,
+		.vertexCountOutput = 0,
+		.vertices = NULL,
+		.indexCapacityInput = 0,
+		.indexCountOutput = 0,
+		.indices = NULL
+	};
+	XrResult result = get_visibility_mask_ptr(p_session, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, p_view, mask_types[p_type], &mask);
+	if (XR_FAILED(result)) {
+		return result;
+	}
+
+	mesh.vertices.resize(mask.vertexCountOutput);
+	mesh.indices.resize(mask.indexCountOutput);
+	if (mask.vertexCountOutput == 0) {
+		// the runtime has no mask for this view, which is allowed
+		mesh.indices.clear();
+		return XR_SUCCESS;
+	}
+
+	mask.vertexCapacityInput = mask.vertexCountOutput;
+	mask.vertices = mesh.vertices.data();
+	mask.indexCapacityInput = mask.indexCountOutput;
+	mask.indices = mesh.indices.data();
+	result = get_visibility_mask_ptr(p_session, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, p_view, mask_types[p_type], &mask);
+	if (XR_FAILED(result)) {
+		mesh.vertices.clear();
+		mesh.indices.clear();
+		return result;
+	}
+
+	mesh.vertices.resize(mask.vertexCountOutput);
+	mesh.indices.resize(mask.indexCountOutput);
+	return XR_SUCCESS;
+}
+
+XrResult VisibilityMask::fetch(XrSession p_session, uint32_t p_view) {
+	if (get_visibility_mask_ptr == NULL || p_view >= versions.size()) {
+		return XR_ERROR_FUNCTION_UNSUPPORTED;
+	}
+
+	for (int t = 0; t < TYPE_MAX; t++) {
+		XrResult result = fetch_mesh(p_session, p_view, (Type)t);
+		if (XR_FAILED(result)) {
+			return result;
+		}
+	}
+
+	versions[p_view]++;
+	return XR_SUCCESS;
+}
+
+const VisibilityMask::Mesh *VisibilityMask::get_mesh(uint32_t p_view, Type p_type) const {
+	if (p_view >= versions.size() || p_type < 0 || p_type >= TYPE_MAX) {
+		return NULL;
+	}
+
+	return &meshes[p_view * TYPE_MAX + p_type];
+}
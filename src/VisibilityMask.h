@@ -0,0 +1,50 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache of the meshes XR_KHR_visibility_mask gives us for each view
+
+#ifndef VISIBILITY_MASK_H
+#define VISIBILITY_MASK_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <openxr/openxr.h>
+
+class VisibilityMask {
+public:
+	enum Type {
+		TYPE_HIDDEN_TRIANGLES, // area of our view the lenses never show
+		TYPE_VISIBLE_TRIANGLES, // area of our view the lenses do show
+		TYPE_LINE_LOOP, // outline of our visible area
+		TYPE_MAX
+	};
+
+	// Vertices are in view space on the z = -1 plane, triangles are wound counter clockwise
+	struct Mesh {
+		std::vector<XrVector2f> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+private:
+	std::vector<Mesh> meshes; // [view * TYPE_MAX + type]
+	std::vector<uint64_t> versions; // per view, increases every time we fetch its meshes
+	PFN_xrGetVisibilityMaskKHR get_visibility_mask_ptr;
+
+	XrResult fetch_mesh(XrSession p_session, uint32_t p_view, Type p_type);
+
+public:
+	VisibilityMask();
+
+	// Our instance must have XR_KHR_visibility_mask enabled, we're unsupported until this succeeds
+	XrResult setup(XrInstance p_instance, uint32_t p_view_count);
+	bool is_supported() const { return get_visibility_mask_ptr != NULL; }
+	void clear();
+
+	// Fetches all meshes for p_view, call once our session exists and whenever the runtime says they changed
+	XrResult fetch(XrSession p_session, uint32_t p_view);
+
+	uint32_t get_view_count() const { return (uint32_t)versions.size(); }
+	uint64_t get_version(uint32_t p_view) const { return p_view < versions.size() ? versions[p_view] : 0; }
+	const Mesh *get_mesh(uint32_t p_view, Type p_type) const;
+};
+
+#endif /* !VISIBILITY_MASK_H */
@@ -0,0 +1,540 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that lets us configure our OpenXR plugin from Godot
+
+#include "gdclasses/OpenXRConfig.h"
+
+using namespace godot;
+
+static Dictionary timing_to_dictionary(const OpenXRApi::TimingCounter &p_counter) {
+	Dictionary dict;
+
+	uint64_t count = p_counter.count;
+	uint64_t total_usec = p_counter.total_usec;
+
+	dict["count"] = (int64_t)count;
+	dict["last_usec"] = (int64_t)p_counter.last_usec;
+	dict["max_usec"] = (int64_t)p_counter.max_usec;
+	dict["avg_usec"] = count > 0 ? (double)total_usec / (double)count : 0.0;
+
+	return dict;
+}
+
+void OpenXRConfig::_register_methods() {
+	register_property<OpenXRConfig, bool>("frame_thread", &OpenXRConfig::set_frame_thread, &OpenXRConfig::get_frame_thread, false);
+	register_property<OpenXRConfig, bool>("pipelined", &OpenXRConfig::set_pipelined, &OpenXRConfig::get_pipelined, false);
+	register_property<OpenXRConfig, int>("swapchain_layout", &OpenXRConfig::set_swapchain_layout, &OpenXRConfig::get_swapchain_layout, OpenXRApi::SWAPCHAIN_LAYOUT_PER_VIEW);
+	register_property<OpenXRConfig, PoolIntArray>("swapchain_formats", &OpenXRConfig::set_swapchain_formats, &OpenXRConfig::get_swapchain_formats, PoolIntArray());
+	register_property<OpenXRConfig, int>("msaa_mode", &OpenXRConfig::set_msaa_mode, &OpenXRConfig::get_msaa_mode, OpenXRApi::MSAA_MODE_RESOLVE);
+	register_property<OpenXRConfig, PoolIntArray>("sample_counts", &OpenXRConfig::set_sample_counts, &OpenXRConfig::get_sample_counts, PoolIntArray());
+	register_property<OpenXRConfig, bool>("submit_depth", &OpenXRConfig::set_submit_depth, &OpenXRConfig::get_submit_depth, false);
+	register_property<OpenXRConfig, int>("copy_method", &OpenXRConfig::set_copy_method, &OpenXRConfig::get_copy_method, CopyEngine::METHOD_AUTO);
+	register_property<OpenXRConfig, int>("swapchain_wait_timeout", &OpenXRConfig::set_swapchain_wait_timeout, &OpenXRConfig::get_swapchain_wait_timeout, 100);
+	register_property<OpenXRConfig, int>("idle_max_sleep", &OpenXRConfig::set_idle_max_sleep, &OpenXRConfig::get_idle_max_sleep, 20);
+	register_property<OpenXRConfig, bool>("late_latch", &OpenXRConfig::set_late_latch, &OpenXRConfig::get_late_latch, false);
+	register_property<OpenXRConfig, bool>("dynamic_resolution", &OpenXRConfig::set_dynamic_resolution, &OpenXRConfig::get_dynamic_resolution, false);
+	register_property<OpenXRConfig, float>("min_render_scale", &OpenXRConfig::set_min_render_scale, &OpenXRConfig::get_min_render_scale, 0.5);
+	register_property<OpenXRConfig, float>("max_render_scale", &OpenXRConfig::set_max_render_scale, &OpenXRConfig::get_max_render_scale, 1.0);
+	register_property<OpenXRConfig, float>("dynamic_resolution_target", &OpenXRConfig::set_dynamic_resolution_target, &OpenXRConfig::get_dynamic_resolution_target, 0.85);
+
+	register_method("get_frame_timing", &OpenXRConfig::get_frame_timing);
+	register_method("reset_frame_timing", &OpenXRConfig::reset_frame_timing);
+	register_method("get_late_latch_stats", &OpenXRConfig::get_late_latch_stats);
+	register_method("reset_late_latch_stats", &OpenXRConfig::reset_late_latch_stats);
+	register_method("get_dynamic_resolution_stats", &OpenXRConfig::get_dynamic_resolution_stats);
+	register_method("get_swapchain_format_info", &OpenXRConfig::get_swapchain_format_info);
+	register_method("get_msaa_stats", &OpenXRConfig::get_msaa_stats);
+	register_method("get_depth_stats", &OpenXRConfig::get_depth_stats);
+	register_method("get_visibility_mask_version", &OpenXRConfig::get_visibility_mask_version);
+	register_method("get_visibility_mask", &OpenXRConfig::get_visibility_mask);
+	register_method("get_selected_copy_method", &OpenXRConfig::get_selected_copy_method);
+	register_method("benchmark_copy", &OpenXRConfig::benchmark_copy);
+}
+
+OpenXRConfig::OpenXRConfig() {
+	openxr_api = OpenXRApi::openxr_get_api();
+}
+
+OpenXRConfig::~OpenXRConfig() {
+	if (openxr_api != NULL) {
+		OpenXRApi::openxr_release_api();
+	}
+}
+
+void OpenXRConfig::_init() {
+	// nothing to do here
+}
+
+bool OpenXRConfig::get_frame_thread() const {
+	if (openxr_api == NULL) {
+		return false;
+	} else {
+		return openxr_api->get_use_frame_thread();
+	}
+}
+
+void OpenXRConfig::set_frame_thread(bool p_enable) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_use_frame_thread(p_enable);
+	}
+}
+
+bool OpenXRConfig::get_pipelined() const {
+	if (openxr_api == NULL) {
+		return false;
+	} else {
+		return openxr_api->get_use_pipelining();
+	}
+}
+
+void OpenXRConfig::set_pipelined(bool p_enable) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_use_pipelining(p_enable);
+	}
+}
+
+int OpenXRConfig::get_swapchain_layout() const {
+	if (openxr_api == NULL) {
+		return OpenXRApi::SWAPCHAIN_LAYOUT_PER_VIEW;
+	} else {
+		return openxr_api->get_swapchain_layout();
+	}
+}
+
+void OpenXRConfig::set_swapchain_layout(int p_layout) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else if (p_layout < OpenXRApi::SWAPCHAIN_LAYOUT_PER_VIEW || p_layout > OpenXRApi::SWAPCHAIN_LAYOUT_SIDE_BY_SIDE) {
+		Godot::print("OpenXR unknown swapchain layout {0}", p_layout);
+	} else {
+		openxr_api->set_swapchain_layout((OpenXRApi::SwapchainLayout)p_layout);
+	}
+}
+
+PoolIntArray OpenXRConfig::get_swapchain_formats() const {
+	PoolIntArray formats;
+
+	if (openxr_api != NULL) {
+		const SwapchainFormatPolicy &policy = openxr_api->get_format_policy();
+		for (int i = 0; i < policy.get_preference_count(); i++) {
+			formats.append(policy.get_preference(i));
+		}
+	}
+
+	return formats;
+}
+
+void OpenXRConfig::set_swapchain_formats(PoolIntArray p_formats) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return;
+	}
+
+	SwapchainFormatPolicy::Format formats[SwapchainFormatPolicy::FORMAT_MAX];
+	int count = 0;
+	for (int i = 0; i < p_formats.size(); i++) {
+		int format = p_formats[i];
+		if (format < 0 || format >= SwapchainFormatPolicy::FORMAT_MAX) {
+			Godot::print("OpenXR unknown swapchain format {0}", format);
+		} else if (count < SwapchainFormatPolicy::FORMAT_MAX) {
+			formats[count++] = (SwapchainFormatPolicy::Format)format;
+		}
+	}
+	openxr_api->set_swapchain_formats(formats, count);
+}
+
+Dictionary OpenXRConfig::get_swapchain_format_info() const {
+	Dictionary info;
+
+	if (openxr_api != NULL) {
+		info["gl_format"] = openxr_api->get_swapchain_format();
+		info["bytes_per_frame"] = (int64_t)openxr_api->get_swapchain_bytes_per_frame();
+	}
+
+	return info;
+}
+
+int OpenXRConfig::get_msaa_mode() const {
+	if (openxr_api == NULL) {
+		return OpenXRApi::MSAA_MODE_RESOLVE;
+	} else {
+		return openxr_api->get_msaa_mode();
+	}
+}
+
+void OpenXRConfig::set_msaa_mode(int p_mode) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else if (p_mode < OpenXRApi::MSAA_MODE_RESOLVE || p_mode > OpenXRApi::MSAA_MODE_NATIVE) {
+		Godot::print("OpenXR unknown MSAA mode {0}", p_mode);
+	} else {
+		openxr_api->set_msaa_mode((OpenXRApi::MSAAMode)p_mode);
+	}
+}
+
+PoolIntArray OpenXRConfig::get_sample_counts() const {
+	PoolIntArray counts;
+
+	if (openxr_api != NULL) {
+		const std::vector<uint32_t> &setting = openxr_api->get_sample_counts();
+		for (size_t i = 0; i < setting.size(); i++) {
+			counts.append(setting[i]);
+		}
+	}
+
+	return counts;
+}
+
+void OpenXRConfig::set_sample_counts(PoolIntArray p_counts) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return;
+	}
+
+	// one entry per view, an empty array uses the runtimes recommendation
+	std::vector<uint32_t> counts;
+	for (int i = 0; i < p_counts.size(); i++) {
+		counts.push_back(p_counts[i] < 1 ? 1 : p_counts[i]);
+	}
+	openxr_api->set_sample_counts(counts);
+}
+
+Dictionary OpenXRConfig::get_msaa_stats() const {
+	Dictionary stats;
+
+	if (openxr_api != NULL) {
+		CopyEngine *copy_engine = openxr_api->get_copy_engine();
+
+		stats["mode"] = openxr_api->get_msaa_mode();
+		stats["left_samples"] = (int64_t)openxr_api->get_view_sample_count(0);
+		stats["right_samples"] = (int64_t)openxr_api->get_view_sample_count(1);
+		stats["timing_supported"] = copy_engine->is_timing_supported();
+		stats["resolve_gpu_usec"] = (int64_t)copy_engine->get_last_gpu_usec();
+		stats["avg_resolve_gpu_usec"] = copy_engine->get_average_gpu_usec();
+		stats["timed_eyes"] = (int64_t)copy_engine->get_timed_copies();
+	}
+
+	return stats;
+}
+
+bool OpenXRConfig::get_submit_depth() const {
+	if (openxr_api == NULL) {
+		return false;
+	} else {
+		return openxr_api->get_use_depth();
+	}
+}
+
+void OpenXRConfig::set_submit_depth(bool p_enable) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_use_depth(p_enable);
+	}
+}
+
+Dictionary OpenXRConfig::get_depth_stats() const {
+	Dictionary stats;
+
+	if (openxr_api != NULL) {
+		stats["submitting"] = openxr_api->is_depth_submitted();
+		stats["frames"] = (int64_t)openxr_api->get_depth_frames();
+	}
+
+	return stats;
+}
+
+int OpenXRConfig::get_visibility_mask_version(int p_view) const {
+	if (openxr_api == NULL || p_view < 0) {
+		return 0;
+	} else {
+		return (int)openxr_api->get_visibility_mask().get_version((uint32_t)p_view);
+	}
+}
+
+Ref<ArrayMesh> OpenXRConfig::get_visibility_mask(int p_view, int p_type) const {
+	Ref<ArrayMesh> mesh;
+
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return mesh;
+	} else if (p_view < 0 || p_type < 0 || p_type >= VisibilityMask::TYPE_MAX) {
+		Godot::print("OpenXR unknown visibility mask {0} for view {1}", p_type, p_view);
+		return mesh;
+	}
+
+	const VisibilityMask::Mesh *mask = openxr_api->get_visibility_mask().get_mesh((uint32_t)p_view, (VisibilityMask::Type)p_type);
+	if (mask == NULL || mask->vertices.empty() || mask->indices.empty()) {
+		// runtime doesn't support visibility masks, or has nothing to hide for this view
+		return mesh;
+	}
+
+	// Our vertices lie on the z = -1 plane in the space of this view. Godot 3 renders both eyes with one ARVRCamera,
+	// so there is no per eye node to attach this to. Draw it with a shader that skips our camera transform,
+	// POSITION = PROJECTION_MATRIX * vec4(VERTEX, 1.0), pushed to the near plane with depth writes and no colour,
+	// and only for the eye being rendered, i.e. discard it when the sign of PROJECTION_MATRIX[2][0] doesn't
+	// match this view. Give it a large extra_cull_margin so it isn't culled.
+	PoolVector3Array vertices;
+	vertices.resize((int)mask->vertices.size());
+	{
+		PoolVector3Array::Write w = vertices.write();
+		for (size_t i = 0; i < mask->vertices.size(); i++) {
+			w.ptr()[i] = Vector3(mask->vertices[i].x, mask->vertices[i].y, -1.0);
+		}
+	}
+
+	PoolIntArray indices;
+	indices.resize((int)mask->indices.size());
+	{
+		PoolIntArray::Write w = indices.write();
+		if (p_type == VisibilityMask::TYPE_LINE_LOOP) {
+			for (size_t i = 0; i < mask->indices.size(); i++) {
+				w.ptr()[i] = (int)mask->indices[i];
+			}
+		} else {
+			// OpenXR winds its triangles counter clockwise, Godot treats clockwise as front facing
+			for (size_t i = 0; i + 2 < mask->indices.size(); i += 3) {
+				w.ptr()[i] = (int)mask->indices[i];
+				w.ptr()[i + 1] = (int)mask->indices[i + 2];
+				w.ptr()[i + 2] = (int)mask->indices[i + 1];
+			}
+		}
+	}
+
+	Array arrays;
+	arrays.resize(Mesh::ARRAY_MAX);
+	arrays[Mesh::ARRAY_VERTEX] = vertices;
+	arrays[Mesh::ARRAY_INDEX] = indices;
+
+	mesh.instance();
+	mesh->add_surface_from_arrays(p_type == VisibilityMask::TYPE_LINE_LOOP ? Mesh::PRIMITIVE_LINE_LOOP : Mesh::PRIMITIVE_TRIANGLES, arrays);
+
+	return mesh;
+}
+
+int OpenXRConfig::get_copy_method() const {
+	if (openxr_api == NULL) {
+		return CopyEngine::METHOD_AUTO;
+	} else {
+		return openxr_api->get_copy_method();
+	}
+}
+
+void OpenXRConfig::set_copy_method(int p_method) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else if (p_method < CopyEngine::METHOD_AUTO || p_method >= CopyEngine::METHOD_MAX) {
+		Godot::print("OpenXR unknown copy method {0}", p_method);
+	} else {
+		openxr_api->set_copy_method((CopyEngine::Method)p_method);
+	}
+}
+
+String OpenXRConfig::get_selected_copy_method() const {
+	if (openxr_api == NULL) {
+		return String();
+	} else {
+		return String(CopyEngine::get_method_name(openxr_api->get_selected_copy_method()));
+	}
+}
+
+Dictionary OpenXRConfig::benchmark_copy(int p_width, int p_height, int p_iterations) {
+	Dictionary results;
+
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else if (p_width <= 0 || p_height <= 0 || p_iterations <= 0) {
+		Godot::print("OpenXR invalid copy benchmark {0}x{1}, {2} iterations", p_width, p_height, p_iterations);
+	} else {
+		// average usec per copy, -1 for methods that can't do this copy
+		uint64_t usec[CopyEngine::METHOD_MAX];
+		openxr_api->benchmark_copy(p_width, p_height, p_iterations, usec);
+		for (int m = CopyEngine::METHOD_COPY_IMAGE; m < CopyEngine::METHOD_MAX; m++) {
+			results[CopyEngine::get_method_name((CopyEngine::Method)m)] = usec[m] == 0 ? (int64_t)-1 : (int64_t)usec[m];
+		}
+	}
+
+	return results;
+}
+
+int OpenXRConfig::get_swapchain_wait_timeout() const {
+	if (openxr_api == NULL) {
+		return 0;
+	} else {
+		return (int)(openxr_api->get_swapchain_wait_timeout_usec() / 1000);
+	}
+}
+
+void OpenXRConfig::set_swapchain_wait_timeout(int p_msec) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_swapchain_wait_timeout_usec(p_msec < 0 ? 0 : (uint64_t)p_msec * 1000);
+	}
+}
+
+int OpenXRConfig::get_idle_max_sleep() const {
+	if (openxr_api == NULL) {
+		return 0;
+	} else {
+		return openxr_api->get_idle_max_sleep_msec();
+	}
+}
+
+void OpenXRConfig::set_idle_max_sleep(int p_msec) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_idle_max_sleep_msec(p_msec);
+	}
+}
+
+Dictionary OpenXRConfig::get_frame_timing() const {
+	Dictionary timing;
+
+	if (openxr_api != NULL) {
+		timing["wait_frame"] = timing_to_dictionary(openxr_api->get_wait_frame_timing());
+		timing["process"] = timing_to_dictionary(openxr_api->get_process_timing());
+		timing["frames_missed"] = (int64_t)openxr_api->get_frames_missed();
+	}
+
+	return timing;
+}
+
+void OpenXRConfig::reset_frame_timing() {
+	if (openxr_api != NULL) {
+		openxr_api->reset_frame_timing();
+	}
+}
+
+bool OpenXRConfig::get_late_latch() const {
+	if (openxr_api == NULL) {
+		return false;
+	} else {
+		return openxr_api->get_late_latch();
+	}
+}
+
+void OpenXRConfig::set_late_latch(bool p_enable) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		// Only our eye views are located again, Godot already moved our controllers and the nodes attached
+		// to our camera during process. Anything rendered relative to those lags behind our views by up to a frame.
+		if (p_enable && !openxr_api->get_late_latch()) {
+			Godot::print("OpenXR late latching updates our views only, controller poses are sampled earlier in the frame");
+		}
+		openxr_api->set_late_latch(p_enable);
+	}
+}
+
+Dictionary OpenXRConfig::get_late_latch_stats() const {
+	Dictionary stats;
+
+	if (openxr_api != NULL) {
+		const OpenXRApi::PoseDeltaStats &delta = openxr_api->get_late_latch_stats();
+
+		stats["count"] = (int64_t)delta.count;
+		stats["last_position"] = delta.last_position;
+		stats["max_position"] = delta.max_position;
+		stats["avg_position"] = delta.count > 0 ? delta.total_position / (double)delta.count : 0.0;
+		stats["last_rotation"] = delta.last_rotation;
+		stats["max_rotation"] = delta.max_rotation;
+		stats["avg_rotation"] = delta.count > 0 ? delta.total_rotation / (double)delta.count : 0.0;
+	}
+
+	return stats;
+}
+
+void OpenXRConfig::reset_late_latch_stats() {
+	if (openxr_api != NULL) {
+		openxr_api->reset_late_latch_stats();
+	}
+}
+
+bool OpenXRConfig::get_dynamic_resolution() const {
+	if (openxr_api == NULL) {
+		return false;
+	} else {
+		return openxr_api->get_dynamic_resolution()->is_enabled();
+	}
+}
+
+void OpenXRConfig::set_dynamic_resolution(bool p_enable) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_dynamic_resolution()->set_enabled(p_enable);
+	}
+}
+
+float OpenXRConfig::get_min_render_scale() const {
+	if (openxr_api == NULL) {
+		return 0.0;
+	} else {
+		return openxr_api->get_dynamic_resolution()->get_min_scale();
+	}
+}
+
+void OpenXRConfig::set_min_render_scale(float p_scale) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_dynamic_resolution()->set_min_scale(p_scale);
+	}
+}
+
+float OpenXRConfig::get_max_render_scale() const {
+	if (openxr_api == NULL) {
+		return 0.0;
+	} else {
+		return openxr_api->get_dynamic_resolution()->get_max_scale();
+	}
+}
+
+void OpenXRConfig::set_max_render_scale(float p_scale) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_max_render_scale(p_scale);
+	}
+}
+
+float OpenXRConfig::get_dynamic_resolution_target() const {
+	if (openxr_api == NULL) {
+		return 0.0;
+	} else {
+		return openxr_api->get_dynamic_resolution()->get_target();
+	}
+}
+
+void OpenXRConfig::set_dynamic_resolution_target(float p_target) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_dynamic_resolution()->set_target(p_target);
+	}
+}
+
+Dictionary OpenXRConfig::get_dynamic_resolution_stats() const {
+	Dictionary stats;
+
+	if (openxr_api != NULL) {
+		DynamicResolution *dynamic_resolution = openxr_api->get_dynamic_resolution();
+
+		uint32_t width = 0;
+		uint32_t height = 0;
+		openxr_api->recommended_rendertarget_size(&width, &height);
+
+		stats["scale"] = dynamic_resolution->get_scale();
+		stats["width"] = (int64_t)width;
+		stats["height"] = (int64_t)height;
+		stats["avg_frame_usec"] = dynamic_resolution->get_average_usec();
+		stats["changes"] = (int64_t)dynamic_resolution->get_changes();
+	}
+
+	return stats;
+}
@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that lets us configure our OpenXR plugin from Godot
+
+#ifndef OPENXR_CONFIG_H
+#define OPENXR_CONFIG_H
+
+#include "OpenXRApi.h"
+
+#include <ArrayMesh.hpp>
+#include <Node.hpp>
+
+namespace godot {
+class OpenXRConfig : public Node {
+	GODOT_CLASS(OpenXRConfig, Node)
+
+private:
+	OpenXRApi *openxr_api;
+
+public:
+	static void _register_methods();
+
+	void _init();
+
+	OpenXRConfig();
+	~OpenXRConfig();
+
+	bool get_frame_thread() const;
+	void set_frame_thread(bool p_enable);
+
+	bool get_pipelined() const;
+	void set_pipelined(bool p_enable);
+
+	int get_swapchain_layout() const;
+	void set_swapchain_layout(int p_layout);
+
+	PoolIntArray get_swapchain_formats() const;
+	void set_swapchain_formats(PoolIntArray p_formats);
+	Dictionary get_swapchain_format_info() const;
+
+	int get_msaa_mode() const;
+	void set_msaa_mode(int p_mode);
+	PoolIntArray get_sample_counts() const;
+	void set_sample_counts(PoolIntArray p_counts);
+	Dictionary get_msaa_stats() const;
+
+	bool get_submit_depth() const;
+	void set_submit_depth(bool p_enable);
+	Dictionary get_depth_stats() const;
+
+	int get_visibility_mask_version(int p_view) const;
+	Ref<ArrayMesh> get_visibility_mask(int p_view, int p_type) const;
+
+	int get_copy_method() const;
+	void set_copy_method(int p_method);
+	String get_selected_copy_method() const;
+	Dictionary benchmark_copy(int p_width, int p_height, int p_iterations);
+
+	int get_swapchain_wait_timeout() const;
+	void set_swapchain_wait_timeout(int p_msec);
+
+	int get_idle_max_sleep() const;
+	void set_idle_max_sleep(int p_msec);
+
+	Dictionary get_frame_timing() const;
+	void reset_frame_timing();
+
+	bool get_late_latch() const;
+	void set_late_latch(bool p_enable);
+
+	Dictionary get_late_latch_stats() const;
+	void reset_late_latch_stats();
+
+	bool get_dynamic_resolution() const;
+	void set_dynamic_resolution(bool p_enable);
+	float get_min_render_scale() const;
+	void set_min_render_scale(float p_scale);
+	float get_max_render_scale() const;
+	void set_max_render_scale(float p_scale);
+	float get_dynamic_resolution_target() const;
+	void set_dynamic_resolution_target(float p_target);
+	Dictionary get_dynamic_resolution_stats() const;
+};
+} // namespace godot
+
+#endif /* !OPENXR_CONFIG_H */
@@ -0,0 +1,74 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that emits signals for the events we receive from OpenXR
+
+#include "gdclasses/OpenXREvents.h"
+
+using namespace godot;
+
+void OpenXREvents::_register_methods() {
+	register_method("_enter_tree", &OpenXREvents::_enter_tree);
+	register_method("_exit_tree", &OpenXREvents::_exit_tree);
+
+	register_property<OpenXREvents, int>("budget", &OpenXREvents::set_budget, &OpenXREvents::get_budget, 16);
+
+	register_method("get_events_dropped", &OpenXREvents::get_events_dropped);
+
+	register_signal<OpenXREvents>("session_state_changed", "state", GODOT_VARIANT_TYPE_INT);
+	register_signal<OpenXREvents>("interaction_profile_changed", "hand", GODOT_VARIANT_TYPE_STRING, "profile", GODOT_VARIANT_TYPE_STRING);
+	register_signal<OpenXREvents>("reference_space_change_pending", "space_type", GODOT_VARIANT_TYPE_INT);
+	register_signal<OpenXREvents>("visibility_mask_changed", "view", GODOT_VARIANT_TYPE_INT);
+	register_signal<OpenXREvents>("instance_loss_pending");
+	register_signal<OpenXREvents>("events_lost", "count", GODOT_VARIANT_TYPE_INT);
+}
+
+OpenXREvents::OpenXREvents() {
+	openxr_api = OpenXRApi::openxr_get_api();
+}
+
+OpenXREvents::~OpenXREvents() {
+	if (openxr_api != NULL) {
+		// just in case we never left our tree
+		openxr_api->unregister_event_listener(this);
+		OpenXRApi::openxr_release_api();
+	}
+}
+
+void OpenXREvents::_init() {
+	// nothing to do here
+}
+
+void OpenXREvents::_enter_tree() {
+	if (openxr_api != NULL) {
+		openxr_api->register_event_listener(this);
+	}
+}
+
+void OpenXREvents::_exit_tree() {
+	if (openxr_api != NULL) {
+		openxr_api->unregister_event_listener(this);
+	}
+}
+
+int OpenXREvents::get_budget() const {
+	if (openxr_api == NULL) {
+		return 0;
+	} else {
+		return openxr_api->get_event_budget();
+	}
+}
+
+void OpenXREvents::set_budget(int p_budget) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->set_event_budget(p_budget);
+	}
+}
+
+int OpenXREvents::get_events_dropped() const {
+	if (openxr_api == NULL) {
+		return 0;
+	} else {
+		return (int)openxr_api->get_events_dropped();
+	}
+}
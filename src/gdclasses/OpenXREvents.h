@@ -0,0 +1,34 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that emits signals for the events we receive from OpenXR
+
+#ifndef OPENXR_EVENTS_H
+#define OPENXR_EVENTS_H
+
+#include "OpenXRApi.h"
+
+#include <Node.hpp>
+
+namespace godot {
+class OpenXREvents : public Node {
+	GODOT_CLASS(OpenXREvents, Node)
+
+private:
+	OpenXRApi *openxr_api;
+
+public:
+	static void _register_methods();
+
+	void _init();
+	void _enter_tree();
+	void _exit_tree();
+
+	OpenXREvents();
+	~OpenXREvents();
+
+	int get_budget() const;
+	void set_budget(int p_budget);
+	int get_events_dropped() const;
+};
+} // namespace godot
+
+#endif /* !OPENXR_EVENTS_H */
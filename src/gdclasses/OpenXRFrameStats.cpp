@@ -0,0 +1,222 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that exposes the timing of our recent frames to Godot
+
+#include "gdclasses/OpenXRFrameStats.h"
+
+using namespace godot;
+
+static PoolIntArray durations_to_array(const uint64_t *p_durations, int p_count) {
+	PoolIntArray arr;
+
+	arr.resize(p_count);
+	PoolIntArray::Write w = arr.write();
+	for (int i = 0; i < p_count; i++) {
+		w.ptr()[i] = (int)p_durations[i];
+	}
+
+	return arr;
+}
+
+static Dictionary percentiles_to_dictionary(uint64_t *p_durations, int p_count) {
+	Dictionary dict;
+
+	dict["count"] = p_count;
+	dict["p50"] = (int64_t)FrameTimings::percentile(p_durations, p_count, 50);
+	dict["p95"] = (int64_t)FrameTimings::percentile(p_durations, p_count, 95);
+	dict["p99"] = (int64_t)FrameTimings::percentile(p_durations, p_count, 99);
+
+	return dict;
+}
+
+void OpenXRFrameStats::_register_methods() {
+	register_property<OpenXRFrameStats, bool>("enabled", &OpenXRFrameStats::set_enabled, &OpenXRFrameStats::get_enabled, true);
+
+	register_method("reset", &OpenXRFrameStats::reset);
+	register_method("get_phase_names", &OpenXRFrameStats::get_phase_names);
+	register_method("get_phase_timestamps", &OpenXRFrameStats::get_phase_timestamps);
+	register_method("get_phase_durations", &OpenXRFrameStats::get_phase_durations);
+	register_method("get_frame_durations", &OpenXRFrameStats::get_frame_durations);
+	register_method("get_summary", &OpenXRFrameStats::get_summary);
+	register_method("get_deadline_stats", &OpenXRFrameStats::get_deadline_stats);
+	register_method("get_recovery_stats", &OpenXRFrameStats::get_recovery_stats);
+	register_method("get_swapchain_wait_stats", &OpenXRFrameStats::get_swapchain_wait_stats);
+}
+
+OpenXRFrameStats::OpenXRFrameStats() {
+	openxr_api = OpenXRApi::openxr_get_api();
+}
+
+OpenXRFrameStats::~OpenXRFrameStats() {
+	if (openxr_api != NULL) {
+		OpenXRApi::openxr_release_api();
+	}
+}
+
+void OpenXRFrameStats::_init() {
+	// nothing to do here
+}
+
+bool OpenXRFrameStats::get_enabled() const {
+	if (openxr_api == NULL) {
+		return false;
+	} else {
+		return openxr_api->get_frame_timings()->is_enabled();
+	}
+}
+
+void OpenXRFrameStats::set_enabled(bool p_enabled) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_frame_timings()->set_enabled(p_enabled);
+	}
+}
+
+void OpenXRFrameStats::reset() {
+	if (openxr_api != NULL) {
+		openxr_api->get_frame_timings()->reset();
+		openxr_api->reset_deadline_stats();
+		openxr_api->reset_recovery_stats();
+		openxr_api->reset_swapchain_wait_stats();
+	}
+}
+
+PoolStringArray OpenXRFrameStats::get_phase_names() const {
+	PoolStringArray names;
+
+	for (int p = 0; p < FrameTimings::PHASE_MAX; p++) {
+		names.append(String(FrameTimings::get_phase_name((FrameTimings::Phase)p)));
+	}
+
+	return names;
+}
+
+PoolIntArray OpenXRFrameStats::get_phase_timestamps(int p_phase) const {
+	PoolIntArray arr;
+
+	if (openxr_api == NULL || p_phase < 0 || p_phase >= FrameTimings::PHASE_MAX) {
+		return arr;
+	}
+
+	// we return usecs since the start of each frame, oldest frame first, -1 if the phase wasn't reached
+	FrameTimings *timings = openxr_api->get_frame_timings();
+	int count = timings->get_frame_count();
+
+	arr.resize(count);
+	PoolIntArray::Write w = arr.write();
+	for (int f = 0; f < count; f++) {
+		uint64_t start = timings->get_timestamp(f, FrameTimings::PHASE_PROCESS_START);
+		uint64_t stamp = timings->get_timestamp(f, (FrameTimings::Phase)p_phase);
+		w.ptr()[f] = (stamp == 0 || stamp < start) ? -1 : (int)(stamp - start);
+	}
+
+	return arr;
+}
+
+PoolIntArray OpenXRFrameStats::get_phase_durations(int p_phase) const {
+	if (openxr_api == NULL || p_phase < 0 || p_phase >= FrameTimings::PHASE_MAX) {
+		return PoolIntArray();
+	}
+
+	uint64_t durations[FrameTimings::FRAME_COUNT];
+	int count = openxr_api->get_frame_timings()->get_phase_durations((FrameTimings::Phase)p_phase, durations);
+	return durations_to_array(durations, count);
+}
+
+PoolIntArray OpenXRFrameStats::get_frame_durations() const {
+	if (openxr_api == NULL) {
+		return PoolIntArray();
+	}
+
+	uint64_t durations[FrameTimings::FRAME_COUNT];
+	int count = openxr_api->get_frame_timings()->get_frame_durations(durations);
+	return durations_to_array(durations, count);
+}
+
+Dictionary OpenXRFrameStats::get_summary() const {
+	Dictionary summary;
+
+	if (openxr_api == NULL) {
+		return summary;
+	}
+
+	FrameTimings *timings = openxr_api->get_frame_timings();
+	uint64_t durations[FrameTimings::FRAME_COUNT];
+
+	for (int p = 0; p < FrameTimings::PHASE_MAX; p++) {
+		int count = timings->get_phase_durations((FrameTimings::Phase)p, durations);
+		summary[FrameTimings::get_phase_name((FrameTimings::Phase)p)] = percentiles_to_dictionary(durations, count);
+	}
+
+	int count = timings->get_frame_durations(durations);
+	summary["frame"] = percentiles_to_dictionary(durations, count);
+
+	return summary;
+}
+
+Dictionary OpenXRFrameStats::get_deadline_stats() const {
+	Dictionary stats;
+
+	if (openxr_api == NULL) {
+		return stats;
+	}
+
+	const OpenXRApi::DeadlineStats &deadline = openxr_api->get_deadline_stats();
+
+	stats["frames_submitted"] = (int64_t)deadline.frames_submitted;
+	stats["frames_late"] = (int64_t)deadline.frames_late;
+	stats["skipped_periods"] = (int64_t)deadline.skipped_periods;
+	stats["frames_not_rendered"] = (int64_t)deadline.frames_not_rendered;
+	stats["frames_not_begun"] = (int64_t)deadline.frames_not_begun;
+	stats["margin_supported"] = deadline.margin_supported;
+	if (deadline.margin_count > 0) {
+		stats["last_margin_usec"] = deadline.last_margin_usec;
+		stats["min_margin_usec"] = deadline.min_margin_usec;
+		stats["avg_margin_usec"] = (double)deadline.total_margin_usec / (double)deadline.margin_count;
+	}
+
+	return stats;
+}
+
+Dictionary OpenXRFrameStats::get_recovery_stats() const {
+	Dictionary stats;
+
+	if (openxr_api == NULL) {
+		return stats;
+	}
+
+	const OpenXRApi::RecoveryStats &recovery = openxr_api->get_recovery_stats();
+
+	stats["sessions_recovered"] = (int64_t)recovery.sessions_recovered;
+	stats["instances_recovered"] = (int64_t)recovery.instances_recovered;
+	stats["failed_attempts"] = (int64_t)recovery.failed_attempts;
+	stats["last_recreate_usec"] = (int64_t)recovery.last_recreate_usec;
+	stats["first_frames"] = (int64_t)recovery.first_frames;
+	stats["last_first_frame_usec"] = (int64_t)recovery.last_first_frame_usec;
+	stats["max_first_frame_usec"] = (int64_t)recovery.max_first_frame_usec;
+
+	return stats;
+}
+
+Dictionary OpenXRFrameStats::get_swapchain_wait_stats() const {
+	Dictionary stats;
+
+	if (openxr_api == NULL) {
+		return stats;
+	}
+
+	const OpenXRApi::SwapchainWaitStats &wait = openxr_api->get_swapchain_wait_stats();
+
+	stats["waits"] = (int64_t)wait.waits;
+	stats["timeouts"] = (int64_t)wait.timeouts;
+	stats["last_wait_usec"] = (int64_t)wait.last_wait_usec;
+	stats["max_wait_usec"] = (int64_t)wait.max_wait_usec;
+	stats["runtime_wait_usec"] = (int64_t)wait.runtime_wait_usec;
+	stats["gpu_busy_wait_usec"] = (int64_t)wait.gpu_busy_wait_usec;
+	stats["gpu_busy_frames"] = (int64_t)wait.gpu_busy_frames;
+	if (wait.waits > 0) {
+		stats["avg_wait_usec"] = (double)(wait.runtime_wait_usec + wait.gpu_busy_wait_usec) / (double)wait.waits;
+	}
+
+	return stats;
+}
@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that exposes the timing of our recent frames to Godot
+
+#ifndef OPENXR_FRAME_STATS_H
+#define OPENXR_FRAME_STATS_H
+
+#include "OpenXRApi.h"
+
+#include <Reference.hpp>
+
+namespace godot {
+class OpenXRFrameStats : public Reference {
+	GODOT_CLASS(OpenXRFrameStats, Reference)
+
+private:
+	OpenXRApi *openxr_api;
+
+public:
+	static void _register_methods();
+
+	void _init();
+
+	OpenXRFrameStats();
+	~OpenXRFrameStats();
+
+	bool get_enabled() const;
+	void set_enabled(bool p_enabled);
+	void reset();
+
+	PoolStringArray get_phase_names() const;
+	PoolIntArray get_phase_timestamps(int p_phase) const;
+	PoolIntArray get_phase_durations(int p_phase) const;
+	PoolIntArray get_frame_durations() const;
+	Dictionary get_summary() const;
+	Dictionary get_deadline_stats() const;
+	Dictionary get_recovery_stats() const;
+	Dictionary get_swapchain_wait_stats() const;
+};
+} // namespace godot
+
+#endif /* !OPENXR_FRAME_STATS_H */
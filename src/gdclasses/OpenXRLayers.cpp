@@ -0,0 +1,387 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that lets us show viewports in composition layers next to our projection layer
+
+#include "gdclasses/OpenXRLayers.h"
+
+#include <ARVRServer.hpp>
+#include <VisualServer.hpp>
+
+using namespace godot;
+
+void OpenXRLayers::_register_methods() {
+	register_method("add_quad", &OpenXRLayers::add_quad);
+	register_method("add_cylinder", &OpenXRLayers::add_cylinder);
+	register_method("add_cube", &OpenXRLayers::add_cube);
+	register_method("add_equirect", &OpenXRLayers::add_equirect);
+	register_method("remove_layer", &OpenXRLayers::remove_layer);
+	register_method("set_layer_transform", &OpenXRLayers::set_layer_transform);
+	register_method("set_layer_size", &OpenXRLayers::set_layer_size);
+	register_method("set_layer_cylinder", &OpenXRLayers::set_layer_cylinder);
+	register_method("set_layer_equirect", &OpenXRLayers::set_layer_equirect);
+	register_method("set_layer_visible", &OpenXRLayers::set_layer_visible);
+	register_method("set_layer_alpha_blend", &OpenXRLayers::set_layer_alpha_blend);
+	register_method("set_layer_sort_order", &OpenXRLayers::set_layer_sort_order);
+	register_method("set_layer_color_scale_bias", &OpenXRLayers::set_layer_color_scale_bias);
+	register_method("set_projection_color_scale_bias", &OpenXRLayers::set_projection_color_scale_bias);
+	register_method("get_hold_frame", &OpenXRLayers::get_hold_frame);
+	register_method("set_hold_frame", &OpenXRLayers::set_hold_frame);
+	register_method("update_layer", &OpenXRLayers::update_layer);
+	register_method("get_layer_stats", &OpenXRLayers::get_layer_stats);
+	register_method("write_equirect_frame", &OpenXRLayers::write_equirect_frame);
+	register_method("get_stream_stats", &OpenXRLayers::get_stream_stats);
+	register_method("benchmark_equirect_upload", &OpenXRLayers::benchmark_equirect_upload);
+}
+
+OpenXRLayers::OpenXRLayers() {
+	openxr_api = OpenXRApi::openxr_get_api();
+}
+
+OpenXRLayers::~OpenXRLayers() {
+	if (openxr_api != NULL) {
+		// our layers go with us
+		for (std::map<int, std::vector<RID> >::iterator it = sources.begin(); it != sources.end(); ++it) {
+			openxr_api->get_composition_layers()->remove_layer(it->first);
+		}
+		sources.clear();
+
+		OpenXRApi::openxr_release_api();
+	}
+}
+
+void OpenXRLayers::_init() {
+	// nothing to do here
+}
+
+float OpenXRLayers::get_world_scale() {
+	ARVRServer *server = ARVRServer::get_singleton();
+	float world_scale = server != NULL ? (float)server->get_world_scale() : 1.0;
+	return world_scale > 0.0 ? world_scale : 1.0;
+}
+
+XrPosef OpenXRLayers::pose_from_transform(const Transform &p_transform, float p_world_scale) {
+	// our layers live in our play space, which is our ARVROrigin in Godot
+	Quat q = p_transform.basis.orthonormalized().get_quat();
+	XrPosef pose = {
+		.orientation = { q.x, q.y, q.z, q.w },
+		.position = { p_transform.origin.x / p_world_scale, p_transform.origin.y / p_world_scale, p_transform.origin.z / p_world_scale }
+	};
+
+	return pose;
+}
+
+int OpenXRLayers::add_layer(CompositionLayers::Shape p_shape, const std::vector<RID> &p_viewports, const XrExtent2Df &p_size, const Transform &p_transform) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return -1;
+	}
+
+	// The compositor samples our viewport at whatever resolution the panel covers on the display,
+	// size the viewport to that and leave render_target_v_flip off, our swapchain is bottom up just like Godots textures.
+	float world_scale = get_world_scale();
+	int id = openxr_api->get_composition_layers()->add_layer(p_shape, p_size);
+	openxr_api->get_composition_layers()->set_pose(id, pose_from_transform(p_transform, world_scale));
+
+	sources[id] = p_viewports;
+	update_layer(id);
+
+	return id;
+}
+
+int OpenXRLayers::add_quad(Viewport *p_viewport, Vector2 p_size, Transform p_transform) {
+	if (p_viewport == NULL) {
+		Godot::print("OpenXR quad layer needs a viewport");
+		return -1;
+	}
+
+	float world_scale = get_world_scale();
+	XrExtent2Df size = { p_size.x / world_scale, p_size.y / world_scale };
+	return add_layer(CompositionLayers::SHAPE_QUAD, std::vector<RID>(1, p_viewport->get_viewport_rid()), size, p_transform);
+}
+
+int OpenXRLayers::add_cylinder(Viewport *p_viewport, float p_radius, float p_central_angle, Transform p_transform) {
+	if (openxr_api != NULL && !openxr_api->get_composition_layers()->is_shape_supported(CompositionLayers::SHAPE_CYLINDER)) {
+		// we still add it, scripts can check get_layer_stats() and fall back to in scene geometry
+		Godot::print("OpenXR runtime doesn't support XR_KHR_composition_layer_cylinder, cylinder layers won't be shown");
+	}
+
+	if (p_viewport == NULL) {
+		Godot::print("OpenXR cylinder layer needs a viewport");
+		return -1;
+	}
+
+	XrExtent2Df size = { 0.0, 0.0 };
+	int id = add_layer(CompositionLayers::SHAPE_CYLINDER, std::vector<RID>(1, p_viewport->get_viewport_rid()), size, p_transform);
+	if (id >= 0) {
+		set_layer_cylinder(id, p_radius, p_central_angle);
+	}
+
+	return id;
+}
+
+int OpenXRLayers::add_cube(Array p_faces, Transform p_transform) {
+	if (openxr_api != NULL && !openxr_api->get_composition_layers()->is_shape_supported(CompositionLayers::SHAPE_CUBE)) {
+		Godot::print("OpenXR runtime doesn't support XR_KHR_composition_layer_cube, cube layers won't be shown");
+	}
+
+	// Six square viewports in GL order (+X, -X, +Y, -Y, +Z, -Z), each with a 90 degree camera looking along its axis.
+	// Cube map faces are stored top down so these need render_target_v_flip on, unlike our other layers.
+	// Set their update mode to once and update our layer when our sky changes, the compositor does the rest.
+	if (p_faces.size() != CompositionLayers::CUBE_FACES) {
+		Godot::print("OpenXR cube layer needs {0} viewports, got {1}", (int64_t)CompositionLayers::CUBE_FACES, (int64_t)p_faces.size());
+		return -1;
+	}
+
+	std::vector<RID> viewports;
+	for (int f = 0; f < CompositionLayers::CUBE_FACES; f++) {
+		Object *object = p_faces[f];
+		Viewport *viewport = Object::cast_to<Viewport>(object);
+		if (viewport == NULL) {
+			Godot::print("OpenXR face {0} of our cube layer isn't a viewport", f);
+			return -1;
+		}
+		viewports.push_back(viewport->get_viewport_rid());
+	}
+
+	// only our orientation matters, our cube is infinitely far away
+	XrExtent2Df size = { 0.0, 0.0 };
+	return add_layer(CompositionLayers::SHAPE_CUBE, viewports, size, p_transform);
+}
+
+int OpenXRLayers::add_equirect(int p_width, int p_height, float p_radius, Transform p_transform) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return -1;
+	} else if (p_width <= 0 || p_height <= 0) {
+		Godot::print("OpenXR invalid equirect size {0}x{1}", p_width, p_height);
+		return -1;
+	} else if (!openxr_api->get_composition_layers()->is_shape_supported(CompositionLayers::SHAPE_EQUIRECT)) {
+		Godot::print("OpenXR runtime doesn't support XR_KHR_composition_layer_equirect2, equirect layers won't be shown");
+	}
+
+	// Our frames come from write_equirect_frame() instead of a viewport, a full sphere unless set_layer_equirect() says otherwise
+	XrExtent2Df size = { 0.0, 0.0 };
+	int id = add_layer(CompositionLayers::SHAPE_EQUIRECT, std::vector<RID>(), size, p_transform);
+	if (id < 0) {
+		return id;
+	}
+
+	if (!openxr_api->get_composition_layers()->create_stream(id, (uint32_t)p_width, (uint32_t)p_height)) {
+		remove_layer(id);
+		return -1;
+	}
+	openxr_api->get_composition_layers()->set_equirect(id, p_radius / get_world_scale(), 2.0f * MATH_PI, MATH_PI / 2.0f, -MATH_PI / 2.0f);
+
+	return id;
+}
+
+void OpenXRLayers::remove_layer(int p_id) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else if (sources.erase(p_id) > 0) {
+		openxr_api->get_composition_layers()->remove_layer(p_id);
+	}
+}
+
+void OpenXRLayers::set_layer_transform(int p_id, Transform p_transform) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_composition_layers()->set_pose(p_id, pose_from_transform(p_transform, get_world_scale()));
+	}
+}
+
+void OpenXRLayers::set_layer_size(int p_id, Vector2 p_size) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		float world_scale = get_world_scale();
+		XrExtent2Df size = { p_size.x / world_scale, p_size.y / world_scale };
+		openxr_api->get_composition_layers()->set_size(p_id, size);
+	}
+}
+
+void OpenXRLayers::set_layer_cylinder(int p_id, float p_radius, float p_central_angle) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		// our transform is the center of our cylinder, our panel faces it from p_radius away
+		openxr_api->get_composition_layers()->set_cylinder(p_id, p_radius / get_world_scale(), p_central_angle);
+	}
+}
+
+void OpenXRLayers::set_layer_equirect(int p_id, float p_radius, float p_central_horizontal_angle, float p_upper_vertical_angle, float p_lower_vertical_angle) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		// a radius of 0 puts our sphere at infinity
+		openxr_api->get_composition_layers()->set_equirect(p_id, p_radius / get_world_scale(), p_central_horizontal_angle, p_upper_vertical_angle, p_lower_vertical_angle);
+	}
+}
+
+void OpenXRLayers::set_layer_visible(int p_id, bool p_visible) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_composition_layers()->set_visible(p_id, p_visible);
+	}
+}
+
+void OpenXRLayers::set_layer_alpha_blend(int p_id, bool p_alpha_blend) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_composition_layers()->set_alpha_blend(p_id, p_alpha_blend);
+	}
+}
+
+void OpenXRLayers::set_layer_sort_order(int p_id, int p_sort_order) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		openxr_api->get_composition_layers()->set_sort_order(p_id, p_sort_order);
+	}
+}
+
+void OpenXRLayers::set_layer_color_scale_bias(int p_id, Color p_scale, Color p_bias) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		XrColor4f scale = { p_scale.r, p_scale.g, p_scale.b, p_scale.a };
+		XrColor4f bias = { p_bias.r, p_bias.g, p_bias.b, p_bias.a };
+		openxr_api->get_composition_layers()->set_color_scale_bias(p_id, scale, bias);
+	}
+}
+
+void OpenXRLayers::set_projection_color_scale_bias(Color p_scale, Color p_bias) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		// i.e. Color(0.2, 0.2, 0.2, 1.0) dims our scene behind a menu, without rendering it again
+		XrColor4f scale = { p_scale.r, p_scale.g, p_scale.b, p_scale.a };
+		XrColor4f bias = { p_bias.r, p_bias.g, p_bias.b, p_bias.a };
+		openxr_api->get_composition_layers()->set_projection_color_scale_bias(scale, bias);
+	}
+}
+
+bool OpenXRLayers::get_hold_frame() const {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return false;
+	} else {
+		return openxr_api->get_hold_frame();
+	}
+}
+
+void OpenXRLayers::set_hold_frame(bool p_hold) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+	} else {
+		// hold our last frame while a scene loads and fade it out with set_projection_color_scale_bias()
+		openxr_api->set_hold_frame(p_hold);
+	}
+}
+
+void OpenXRLayers::update_layer(int p_id) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return;
+	}
+
+	std::map<int, std::vector<RID> >::iterator it = sources.find(p_id);
+	if (it == sources.end()) {
+		Godot::print("OpenXR unknown layer {0}", p_id);
+		return;
+	}
+
+	// Godot recreates our viewports texture when it is resized so we look it up every time.
+	// Our layer copies it with our next frame, after Godot has drawn our viewport.
+	VisualServer *vs = VisualServer::get_singleton();
+	for (size_t f = 0; f < it->second.size(); f++) {
+		RID texture = vs->viewport_get_texture(it->second[f]);
+		uint32_t texid = (uint32_t)vs->texture_get_texid(texture);
+		uint32_t width = (uint32_t)vs->texture_get_width(texture);
+		uint32_t height = (uint32_t)vs->texture_get_height(texture);
+		if (texid == 0 || width == 0 || height == 0) {
+			Godot::print("OpenXR layer {0} has no viewport texture to show", p_id);
+			return;
+		}
+
+		openxr_api->get_composition_layers()->set_source(p_id, (int)f, texid, width, height);
+	}
+}
+
+bool OpenXRLayers::write_equirect_frame(int p_id, PoolByteArray p_data) {
+	if (openxr_api == NULL) {
+		Godot::print("OpenXR object wasn't constructed.");
+		return false;
+	}
+
+	// RGBA8 rows top down, i.e. Image.get_data() of an FORMAT_RGBA8 image.
+	// Returns false if the frame was the wrong size or if every buffer was still busy, we then skip this frame.
+	PoolByteArray::Read r = p_data.read();
+	return openxr_api->get_composition_layers()->write_stream_frame(p_id, r.ptr(), (size_t)p_data.size());
+}
+
+Dictionary OpenXRLayers::get_stream_stats(int p_id) const {
+	Dictionary stats;
+
+	StreamUploader::Stats stream_stats;
+	if (openxr_api != NULL && openxr_api->get_composition_layers()->get_stream_stats(p_id, &stream_stats)) {
+		stats["frames_written"] = (int64_t)stream_stats.frames_written;
+		stats["frames_uploaded"] = (int64_t)stream_stats.frames_uploaded;
+		stats["frames_dropped"] = (int64_t)stream_stats.frames_dropped;
+		stats["writes_refused"] = (int64_t)stream_stats.writes_refused;
+		stats["last_upload_usec"] = (int64_t)stream_stats.last_upload_usec;
+	}
+
+	return stats;
+}
+
+Dictionary OpenXRLayers::benchmark_equirect_upload(int p_width, int p_height, int p_frames) {
+	Dictionary results;
+
+	if (p_width <= 0 || p_height <= 0 || p_frames <= 0) {
+		Godot::print("OpenXR invalid equirect benchmark {0}x{1}, {2} frames", p_width, p_height, p_frames);
+		return results;
+	}
+
+	// i.e. 3840x2160 for 4K video, it needs to keep up with 60 frames a second
+	StreamUploader::BenchmarkResults benchmark;
+	if (!StreamUploader::benchmark((uint32_t)p_width, (uint32_t)p_height, p_frames, &benchmark)) {
+		return results;
+	}
+
+	double fps = benchmark.total_usec > 0 ? 1000000.0 * p_frames / benchmark.total_usec : 0.0;
+	double direct_fps = benchmark.direct_usec > 0 ? 1000000.0 * p_frames / benchmark.direct_usec : 0.0;
+	results["persistent"] = StreamUploader::is_persistent_supported();
+	results["write_usec"] = (int64_t)benchmark.write_usec;
+	results["upload_usec"] = (int64_t)benchmark.upload_usec;
+	results["stall_usec"] = (int64_t)benchmark.stall_usec;
+	results["total_usec"] = (int64_t)benchmark.total_usec;
+	results["fps"] = fps;
+	results["direct_usec"] = (int64_t)benchmark.direct_usec;
+	results["direct_fps"] = direct_fps;
+	results["sustains_60"] = fps >= 60.0;
+
+	return results;
+}
+
+Dictionary OpenXRLayers::get_layer_stats() const {
+	Dictionary stats;
+
+	if (openxr_api != NULL) {
+		const CompositionLayers::Stats &layer_stats = openxr_api->get_composition_layers()->get_stats();
+		stats["layers"] = (int64_t)layer_stats.layers;
+		stats["submitted"] = (int64_t)layer_stats.submitted;
+		stats["updates"] = (int64_t)layer_stats.updates;
+		stats["last_update_usec"] = (int64_t)layer_stats.last_update_usec;
+		stats["wait_timeouts"] = (int64_t)layer_stats.wait_timeouts;
+		stats["cylinder_supported"] = openxr_api->get_composition_layers()->is_shape_supported(CompositionLayers::SHAPE_CYLINDER);
+		stats["cube_supported"] = openxr_api->get_composition_layers()->is_shape_supported(CompositionLayers::SHAPE_CUBE);
+		stats["equirect_supported"] = openxr_api->get_composition_layers()->is_shape_supported(CompositionLayers::SHAPE_EQUIRECT);
+		stats["color_scale_bias_supported"] = openxr_api->get_composition_layers()->is_color_scale_bias_supported();
+		stats["held_frames"] = (int64_t)openxr_api->get_held_frames();
+	}
+
+	return stats;
+}
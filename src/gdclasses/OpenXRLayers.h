@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////////////////////
+// GDNative class that lets us show viewports in composition layers next to our projection layer
+
+#ifndef OPENXR_LAYERS_H
+#define OPENXR_LAYERS_H
+
+#include "OpenXRApi.h"
+
+#include <map>
+
+#include <Node.hpp>
+#include <Viewport.hpp>
+
+namespace godot {
+class OpenXRLayers : public Node {
+	GODOT_CLASS(OpenXRLayers, Node)
+
+private:
+	OpenXRApi *openxr_api;
+	std::map<int, std::vector<RID> > sources; // the viewport each of our layers shows, or each face of our cubes
+
+	static XrPosef pose_from_transform(const Transform &p_transform, float p_world_scale);
+	static float get_world_scale();
+	int add_layer(CompositionLayers::Shape p_shape, const std::vector<RID> &p_viewports, const XrExtent2Df &p_size, const Transform &p_transform);
+
+public:
+	static void _register_methods();
+
+	void _init();
+
+	OpenXRLayers();
+	~OpenXRLayers();
+
+	int add_quad(Viewport *p_viewport, Vector2 p_size, Transform p_transform);
+	int add_cylinder(Viewport *p_viewport, float p_radius, float p_central_angle, Transform p_transform);
+	int add_cube(Array p_faces, Transform p_transform);
+	int add_equirect(int p_width, int p_height, float p_radius, Transform p_transform);
+	void remove_layer(int p_id);
+
+	void set_layer_transform(int p_id, Transform p_transform);
+	void set_layer_size(int p_id, Vector2 p_size);
+	void set_layer_cylinder(int p_id, float p_radius, float p_central_angle);
+	void set_layer_equirect(int p_id, float p_radius, float p_central_horizontal_angle, float p_upper_vertical_angle, float p_lower_vertical_angle);
+	void set_layer_visible(int p_id, bool p_visible);
+	void set_layer_alpha_blend(int p_id, bool p_alpha_blend);
+	void set_layer_sort_order(int p_id, int p_sort_order);
+	void set_layer_color_scale_bias(int p_id, Color p_scale, Color p_bias);
+	void set_projection_color_scale_bias(Color p_scale, Color p_bias);
+	bool get_hold_frame() const;
+	void set_hold_frame(bool p_hold);
+	void update_layer(int p_id);
+
+	bool write_equirect_frame(int p_id, PoolByteArray p_data);
+	Dictionary get_stream_stats(int p_id) const;
+	Dictionary benchmark_equirect_upload(int p_width, int p_height, int p_frames);
+
+	Dictionary get_layer_stats() const;
+};
+} // namespace godot
+
+#endif /* !OPENXR_LAYERS_H */
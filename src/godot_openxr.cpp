@@ -6,6 +6,11 @@
 
 #include "godot_openxr.h"
 
+#include "gdclasses/OpenXRConfig.h"
+#include "gdclasses/OpenXREvents.h"
+#include "gdclasses/OpenXRFrameStats.h"
+#include "gdclasses/OpenXRLayers.h"
+
 void GDN_EXPORT godot_openxr_gdnative_init(godot_gdnative_init_options *o) {
 	godot::Godot::gdnative_init(o);
 }
@@ -23,5 +28,8 @@ void GDN_EXPORT godot_openxr_gdnative_singleton() {
 void GDN_EXPORT godot_openxr_nativescript_init(void *p_handle) {
 	godot::Godot::nativescript_init(p_handle);
 
-	// godot::register_class<godot::OpenXR...>();
+	godot::register_class<godot::OpenXRConfig>();
+	godot::register_class<godot::OpenXREvents>();
+	godot::register_class<godot::OpenXRFrameStats>();
+	godot::register_class<godot::OpenXRLayers>();
 }